@@ -0,0 +1,45 @@
+#include "heapusage.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Kept apart from the benchmarks, so the replaced operators are not inlined
+// into their callers
+
+/// Bytes currently allocated with operator new.
+static std::atomic<long long> liveBytes{0};
+
+/// Allocations are prefixed with their size, padded to keep their alignment.
+static const size_t HEADER_SIZE = alignof(std::max_align_t);
+
+long long getLiveBytes(){
+    return liveBytes;
+}
+
+void* operator new(size_t n){
+    void *block = std::malloc(n + HEADER_SIZE);
+    if(block == nullptr) throw std::bad_alloc();
+    *static_cast<size_t*>(block) = n;
+    liveBytes += (long long)n;
+    return static_cast<char*>(block) + HEADER_SIZE;
+}
+
+void* operator new(size_t n, const std::nothrow_t&) noexcept{
+    try {
+        return operator new(n);
+    } catch(const std::bad_alloc&){
+        return nullptr;
+    }
+}
+
+void operator delete(void *p) noexcept{
+    if(p == nullptr) return;
+    char *block = static_cast<char*>(p) - HEADER_SIZE;
+    liveBytes -= (long long)*reinterpret_cast<size_t*>(block);
+    std::free(block);
+}
+
+void operator delete(void *p, size_t) noexcept{ operator delete(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept{ operator delete(p); }
@@ -0,0 +1,16 @@
+#ifndef HEAP_USAGE_H_INCLUDED
+#define HEAP_USAGE_H_INCLUDED
+
+/**
+ * @brief Get heap memory in use, in bytes.
+ *
+ * Counted by replacing the global operator new/delete, so it includes all
+ * memory allocated with new (by the library, the standard library and SFML),
+ * excluding allocator overhead. Memory allocated with malloc (e.g., by
+ * FreeType or GL drivers) is not counted.
+ *
+ * @return long long    Bytes allocated with new and not yet deleted
+ */
+long long getLiveBytes();
+
+#endif // HEAP_USAGE_H_INCLUDED
@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "graphviewer.h"
+#include "idindex.h"
+#include "heapusage.h"
+
+/**
+ * Benchmarks of the main operations of GraphViewer on synthetic graphs.
+ *
+ * Usage: graphviewer_bench [--min-size N] [--max-size N] [--repeat R]
+ *                          [--no-render] [--output FILE]
+ *
+ * Every generator is run with 1e3, 1e4, 1e5 and 1e6 nodes (limited by
+ * --min-size/--max-size), and the results are written as JSON to stdout or
+ * to the output file. With --repeat, every measurement is taken R times and
+ * the fastest is kept. ID lookups are also compared between IdIndex and
+ * std::unordered_map, with dense and sparse IDs.
+ *
+ * Every measurement also reports the change in heap memory in use across the
+ * operation (see heapusage.h); e.g., the bytes of add_nodes_bulk and
+ * add_edges_bulk are the memory footprint of nodes and edges.
+ */
+
+typedef GraphViewer::id_t Id;
+
+const float SPACING = 50.0f;            ///< Average distance between nodes, in pixels.
+const unsigned RENDER_WIDTH  = 1600;    ///< Width of rendered frames, in pixels.
+const unsigned RENDER_HEIGHT = 900;     ///< Height of rendered frames, in pixels.
+const unsigned SEED = 42;               ///< Seed of generators, so graphs are reproducible.
+const float PI = 3.14159265358979f;
+
+/**
+ * @brief Synthetic graph.
+ */
+struct Graph {
+    std::string name;
+    std::vector<GraphViewer::NodeDescriptor> nodes;
+    std::vector<GraphViewer::EdgeDescriptor> edges;
+
+    void addNode(float x, float y){
+        GraphViewer::NodeDescriptor d;
+        d.id = Id(nodes.size());
+        d.position = sf::Vector2f(x, y);
+        nodes.push_back(d);
+    }
+    void addEdge(Id u, Id v){
+        GraphViewer::EdgeDescriptor d;
+        d.id = Id(edges.size());
+        d.u = u;
+        d.v = v;
+        edges.push_back(d);
+    }
+};
+
+/**
+ * @brief Square grid, with each node connected to its right and bottom
+ *        neighbours.
+ */
+Graph makeGrid(size_t n){
+    Graph g;
+    g.name = "grid";
+    size_t side = size_t(std::ceil(std::sqrt(double(n))));
+    for(size_t i = 0; i < n; ++i)
+        g.addNode(float(i%side)*SPACING, float(i/side)*SPACING);
+    for(size_t i = 0; i < n; ++i){
+        if(i%side+1 < side && i+1 < n) g.addEdge(Id(i), Id(i+1));
+        if(i+side < n)                 g.addEdge(Id(i), Id(i+side));
+    }
+    return g;
+}
+
+/**
+ * @brief Random geometric graph: nodes placed uniformly at random, and
+ *        connected if they are closer than a radius chosen for an average
+ *        degree of about 6.
+ */
+Graph makeRandomGeometric(size_t n){
+    Graph g;
+    g.name = "random_geometric";
+    std::mt19937 rng(SEED);
+    float side = std::sqrt(float(n))*SPACING;
+    std::uniform_real_distribution<float> coord(0.0f, side);
+    for(size_t i = 0; i < n; ++i)
+        g.addNode(coord(rng), coord(rng));
+
+    // Bucket nodes in cells as large as the radius, so only nodes in
+    // neighbouring cells have to be compared
+    float radius = SPACING*std::sqrt(6.0f/PI);
+    size_t cells = size_t(side/radius) + 1;
+    std::vector<std::vector<Id>> buckets(cells*cells);
+    auto cellOf = [&](float c){ return std::min(size_t(c/radius), cells-1); };
+    for(const GraphViewer::NodeDescriptor &d: g.nodes)
+        buckets[cellOf(d.position.y)*cells + cellOf(d.position.x)].push_back(d.id);
+    for(const GraphViewer::NodeDescriptor &d: g.nodes){
+        size_t cx = cellOf(d.position.x), cy = cellOf(d.position.y);
+        for(size_t y = (cy > 0 ? cy-1 : 0); y <= std::min(cy+1, cells-1); ++y){
+            for(size_t x = (cx > 0 ? cx-1 : 0); x <= std::min(cx+1, cells-1); ++x){
+                for(Id j: buckets[y*cells + x]){
+                    if(j <= d.id) continue;
+                    sf::Vector2f delta = g.nodes[size_t(j)].position - d.position;
+                    if(delta.x*delta.x + delta.y*delta.y < radius*radius)
+                        g.addEdge(d.id, j);
+                }
+            }
+        }
+    }
+    return g;
+}
+
+/**
+ * @brief Scale-free graph, by Barabasi-Albert preferential attachment: each
+ *        new node connects to 2 existing nodes, chosen with probability
+ *        proportional to their degree. Nodes are placed at random.
+ */
+Graph makeScaleFree(size_t n){
+    Graph g;
+    g.name = "scale_free";
+    std::mt19937 rng(SEED);
+    float side = std::sqrt(float(n))*SPACING;
+    std::uniform_real_distribution<float> coord(0.0f, side);
+    std::vector<Id> endpoints;
+    for(size_t i = 0; i < n; ++i){
+        g.addNode(coord(rng), coord(rng));
+        Id u = Id(i);
+        if(i == 0) continue;
+        if(i == 1){
+            g.addEdge(0, 1);
+            endpoints.push_back(0);
+            endpoints.push_back(1);
+            continue;
+        }
+        std::uniform_int_distribution<size_t> pick(0, endpoints.size()-1);
+        Id a = endpoints[pick(rng)];
+        Id b = a;
+        for(int tries = 0; b == a && tries < 8; ++tries)
+            b = endpoints[pick(rng)];
+        std::vector<Id> targets = {a};
+        if(b != a) targets.push_back(b);
+        for(Id v: targets){
+            g.addEdge(u, v);
+            endpoints.push_back(u);
+            endpoints.push_back(v);
+        }
+    }
+    return g;
+}
+
+/**
+ * @brief Stars: hubs on a grid, each connected to up to 10000 leaves placed
+ *        in a disc around it.
+ */
+Graph makeStars(size_t n){
+    Graph g;
+    g.name = "stars";
+    const size_t LEAVES = 10000;
+    size_t hubs = std::max(size_t(1), (n + LEAVES) / (LEAVES + 1));
+    size_t side = size_t(std::ceil(std::sqrt(double(hubs))));
+    float discRadius = std::sqrt(float(LEAVES))*SPACING;
+    std::mt19937 rng(SEED);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for(size_t h = 0; h < hubs; ++h)
+        g.addNode(float(h%side)*3.0f*discRadius, float(h/side)*3.0f*discRadius);
+    for(size_t i = hubs; i < n; ++i){
+        size_t h = i%hubs;
+        float r = discRadius*std::sqrt(unit(rng));
+        float a = 2.0f*PI*unit(rng);
+        const sf::Vector2f &center = g.nodes[h].position;
+        g.addNode(center.x + r*std::cos(a), center.y + r*std::sin(a));
+        g.addEdge(Id(h), Id(i));
+    }
+    return g;
+}
+
+/**
+ * @brief Result of one measurement.
+ */
+struct Result {
+    std::string graph;
+    size_t nodes;
+    size_t edges;
+    std::string operation;
+    size_t count;       ///< Number of elements the operation was applied to.
+    double seconds;
+    long long bytes;    ///< Change in heap memory in use.
+};
+
+/**
+ * @brief Time and heap memory change of an operation.
+ */
+struct Measurement {
+    double seconds;
+    long long bytes;
+};
+
+template<class F>
+Measurement measure(F f){
+    long long bytes = getLiveBytes();
+    auto begin = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return Measurement{std::chrono::duration<double>(end - begin).count(), getLiveBytes() - bytes};
+}
+
+/**
+ * @brief Time all operations on a graph.
+ *
+ * @param g         Graph
+ * @param render    True to time rendering frames
+ * @return std::vector<Result>  Measurements, in the same order in every call
+ */
+std::vector<Result> run(const Graph &g, bool render){
+    std::vector<Result> ret;
+    auto add = [&](const std::string &operation, size_t count, const Measurement &m){
+        ret.push_back(Result{g.name, g.nodes.size(), g.edges.size(), operation, count, m.seconds, m.bytes});
+    };
+
+    // One node/edge at a time
+    {
+        GraphViewer gv;
+        add("add_node", g.nodes.size(), measure([&](){
+            for(const GraphViewer::NodeDescriptor &d: g.nodes)
+                gv.addNode(d.id, d.position);
+        }));
+        add("add_edge", g.edges.size(), measure([&](){
+            for(const GraphViewer::EdgeDescriptor &d: g.edges)
+                gv.addEdge(d.id, gv.getNode(d.u), gv.getNode(d.v), d.edge_type);
+        }));
+        add("clear", g.nodes.size() + g.edges.size(), measure([&](){
+            gv.clear();
+        }));
+    }
+
+    GraphViewer gv;
+    add("add_nodes_bulk", g.nodes.size(), measure([&](){ gv.addNodes(g.nodes); }));
+    add("add_edges_bulk", g.edges.size(), measure([&](){ gv.addEdges(g.edges); }));
+
+    add("node_set_position", g.nodes.size(), measure([&](){
+        for(const GraphViewer::NodeDescriptor &d: g.nodes)
+            gv.getNode(d.id).setPosition(d.position + sf::Vector2f(1.0f, 1.0f));
+    }));
+    {
+        // Moves every node by a different offset each repetition, as a
+        // simulation step would
+        std::vector<GraphViewer::id_t> ids;
+        std::vector<sf::Vector2f> positions(g.nodes.size());
+        for(const GraphViewer::NodeDescriptor &d: g.nodes) ids.push_back(d.id);
+        float offset = 0.0f;
+        add("set_positions_bulk", g.nodes.size(), measure([&](){
+            offset += 1.0f;
+            for(size_t i = 0; i < g.nodes.size(); ++i)
+                positions[i] = g.nodes[i].position + sf::Vector2f(offset, offset);
+            gv.setPositions(ids.data(), positions.data(), ids.size());
+        }));
+    }
+    add("edge_set_color", g.edges.size(), measure([&](){
+        for(const GraphViewer::EdgeDescriptor &d: g.edges)
+            gv.getEdge(d.id).setColor(sf::Color::Blue);
+    }));
+
+    // The first call zips edges as they are added; the second rebuilds the
+    // whole zip
+    gv.setZipEdges(true);
+    add("update_zip", g.edges.size(), measure([&](){ gv.setZipEdges(true); }));
+
+    if(render){
+        sf::Vector2f lo = g.nodes[0].position, hi = lo;
+        for(const GraphViewer::NodeDescriptor &d: g.nodes){
+            lo.x = std::min(lo.x, d.position.x); hi.x = std::max(hi.x, d.position.x);
+            lo.y = std::min(lo.y, d.position.y); hi.y = std::max(hi.y, d.position.y);
+        }
+        sf::Vector2f center = (lo + hi)/2.0f;
+        float scale = std::max((hi.x-lo.x)/float(RENDER_WIDTH), (hi.y-lo.y)/float(RENDER_HEIGHT))*1.05f;
+        scale = std::max(scale, 1.0f);
+        // The first frame also creates the render texture
+        gv.renderToImage(RENDER_WIDTH, RENDER_HEIGHT, center, scale);
+        add("render_frame", g.nodes.size() + g.edges.size(), measure([&](){
+            gv.renderToImage(RENDER_WIDTH, RENDER_HEIGHT, center, scale);
+        }));
+    }
+
+    // Remove the nodes with the highest degree, which also removes most
+    // edges in the stars graph
+    std::vector<std::pair<size_t, Id>> degrees;
+    degrees.reserve(g.nodes.size());
+    for(const GraphViewer::NodeDescriptor &d: g.nodes)
+        degrees.emplace_back(gv.getNode(d.id).getDegree(), d.id);
+    size_t hubs = std::max(size_t(1), g.nodes.size()/1000);
+    std::partial_sort(degrees.begin(), degrees.begin() + hubs, degrees.end(), std::greater<std::pair<size_t, Id>>());
+    size_t edges = g.edges.size();
+    Measurement m = measure([&](){
+        for(size_t i = 0; i < hubs; ++i)
+            gv.removeNode(degrees[i].second);
+    });
+    add("remove_hubs", hubs + edges - gv.getEdges().size(), m);
+
+    return ret;
+}
+
+/**
+ * @brief Time looking up every ID, in random order, in an IdIndex and in a
+ *        std::unordered_map.
+ *
+ * @param name      Name of the ID distribution
+ * @param ids       IDs
+ * @return std::vector<Result>  Measurements, in the same order in every call
+ */
+std::vector<Result> runLookups(const std::string &name, const std::vector<Id> &ids){
+    std::vector<Result> ret;
+    auto add = [&](const std::string &operation, const Measurement &m){
+        ret.push_back(Result{name, ids.size(), 0, operation, ids.size(), m.seconds, m.bytes});
+    };
+
+    std::vector<int> objects(ids.size());
+    IdIndex<int> index;
+    std::unordered_map<Id, int*> map;
+    for(size_t i = 0; i < ids.size(); ++i){
+        index.insert(ids[i], &objects[i]);
+        map[ids[i]] = &objects[i];
+    }
+    std::vector<Id> queries = ids;
+    std::shuffle(queries.begin(), queries.end(), std::mt19937(SEED));
+
+    // Sum results, so lookups are not optimized away
+    volatile size_t sink = 0;
+    add("lookup_unordered_map", measure([&](){
+        size_t sum = 0;
+        for(Id id: queries) sum += size_t(map.at(id) - objects.data());
+        sink = sink + sum;
+    }));
+    add("lookup_id_index", measure([&](){
+        size_t sum = 0;
+        for(Id id: queries) sum += size_t(index.at(id) - objects.data());
+        sink = sink + sum;
+    }));
+    return ret;
+}
+
+/**
+ * @brief Keep the fastest of repeated measurements.
+ *
+ * @param repeat    Number of times to take each measurement
+ * @param f         Function taking all measurements
+ * @return std::vector<Result>  Fastest measurements
+ */
+template<class F>
+std::vector<Result> best(unsigned repeat, F f){
+    std::vector<Result> ret;
+    for(unsigned r = 0; r < repeat; ++r){
+        std::vector<Result> current = f();
+        if(ret.empty()) ret = current;
+        else for(size_t i = 0; i < ret.size(); ++i)
+            ret[i].seconds = std::min(ret[i].seconds, current[i].seconds);
+    }
+    return ret;
+}
+
+void writeJson(std::ostream &os, const std::vector<Result> &results, unsigned repeat){
+    os << "{\n";
+    os << "  \"benchmark\": \"graphviewer\",\n";
+    os << "  \"repeat\": " << repeat << ",\n";
+    os << "  \"results\": [";
+    for(size_t i = 0; i < results.size(); ++i){
+        const Result &r = results[i];
+        os << (i == 0 ? "\n" : ",\n");
+        os << "    {\"graph\": \"" << r.graph << "\""
+           << ", \"nodes\": " << r.nodes
+           << ", \"edges\": " << r.edges
+           << ", \"operation\": \"" << r.operation << "\""
+           << ", \"count\": " << r.count
+           << ", \"seconds\": " << r.seconds
+           << ", \"ns_per_element\": " << (r.count > 0 ? r.seconds*1e9/double(r.count) : 0.0)
+           << ", \"bytes\": " << r.bytes
+           << ", \"bytes_per_element\": " << (r.count > 0 ? double(r.bytes)/double(r.count) : 0.0)
+           << "}";
+    }
+    os << "\n  ]\n";
+    os << "}\n";
+}
+
+int main(int argc, char *argv[]) {
+    size_t minSize = 1000;
+    size_t maxSize = 1000000;
+    unsigned repeat = 1;
+    bool render = true;
+    std::string output;
+
+    try {
+        for(int i = 1; i < argc; ++i){
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if(i+1 >= argc) throw std::invalid_argument("Missing value of " + arg);
+                return argv[++i];
+            };
+            if     (arg == "--min-size" ) minSize = std::stoul(value());
+            else if(arg == "--max-size" ) maxSize = std::stoul(value());
+            else if(arg == "--repeat"   ) repeat  = unsigned(std::stoul(value()));
+            else if(arg == "--output"   ) output  = value();
+            else if(arg == "--no-render") render  = false;
+            else throw std::invalid_argument("Unknown argument " + arg);
+        }
+        if(repeat == 0) throw std::invalid_argument("--repeat must be positive");
+    } catch(const std::exception &e){
+        std::cerr << e.what() << "\n"
+                  << "Usage: " << argv[0] << " [--min-size N] [--max-size N] [--repeat R] [--no-render] [--output FILE]\n";
+        return 1;
+    }
+
+    Graph (*generators[])(size_t) = {makeGrid, makeRandomGeometric, makeScaleFree, makeStars};
+
+    std::vector<Result> results;
+    for(size_t n = 1000; n <= 1000000; n *= 10){
+        if(n < minSize || n > maxSize) continue;
+        for(auto generator: generators){
+            Graph g = generator(n);
+            std::cerr << g.name << ": " << g.nodes.size() << " nodes, " << g.edges.size() << " edges" << std::endl;
+            std::vector<Result> current = best(repeat, [&](){ return run(g, render); });
+            results.insert(results.end(), current.begin(), current.end());
+        }
+
+        std::vector<Id> dense(n), sparse(n);
+        std::mt19937_64 rng(SEED);
+        for(size_t i = 0; i < n; ++i){
+            dense[i] = Id(i);
+            sparse[i] = Id(rng() >> 1);
+        }
+        std::sort(sparse.begin(), sparse.end());
+        sparse.erase(std::unique(sparse.begin(), sparse.end()), sparse.end());
+        auto lookups = [&](const std::string &name, const std::vector<Id> &ids){
+            std::vector<Result> current = best(repeat, [&](){ return runLookups(name, ids); });
+            results.insert(results.end(), current.begin(), current.end());
+        };
+        lookups("dense_ids", dense);
+        lookups("sparse_ids", sparse);
+    }
+
+    if(output.empty()){
+        writeJson(std::cout, results, repeat);
+    } else {
+        std::ofstream os(output);
+        writeJson(os, results, repeat);
+        if(!os) {
+            std::cerr << "Failed to write " << output << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
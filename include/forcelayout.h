@@ -0,0 +1,311 @@
+#ifndef FORCE_LAYOUT_H_INCLUDED
+#define FORCE_LAYOUT_H_INCLUDED
+
+#include <atomic>
+#include <exception>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "graphviewer.h"
+
+/**
+ * @brief Force-directed layout of the nodes of a graph.
+ *
+ * Nodes repel each other and edges pull their endpoints together, as in the
+ * spring-electrical model of Fruchterman and Reingold, and nodes move along
+ * the net force by a step length that adapts to whether the layout is still
+ * improving, as proposed by Hu. Repulsion is approximated with a Barnes-Hut
+ * quadtree, so each iteration takes O(n log n) time, and forces are
+ * computed in parallel.
+ *
+ * Unless nodes already have a layout, which is then refined, the graph is
+ * first coarsened by repeatedly collapsing pairs of adjacent nodes; the
+ * coarsest graph is laid out from random positions, and each finer graph is
+ * laid out starting from the positions of the nodes it was collapsed into.
+ * This avoids most of the folds a layout from random positions gets stuck
+ * in, and converges in fewer iterations.
+ *
+ * The layout works on a copy of the nodes and edges of the graph, taken
+ * when it starts; elements added afterwards are ignored, and nodes must not
+ * be removed while it runs. Positions are written back to the graph every
+ * few iterations, so the layout can be watched as it converges, and when it
+ * ends.
+ */
+class ForceLayout {
+private:
+    /**
+     * @brief Layout parameters, copied when the layout starts.
+     */
+    struct Parameters {
+        unsigned iterations;            ///< @brief Maximum number of iterations of the coarsest level.
+        unsigned refinementIterations;  ///< @brief Maximum number of iterations of finer levels.
+        float edgeLength;               ///< @brief Ideal edge length, in pixels.
+        float theta;                    ///< @brief Barnes-Hut opening angle.
+        float gravity;                  ///< @brief Strength of pull to the center.
+        unsigned threads;               ///< @brief Number of threads.
+        unsigned updateInterval;        ///< @brief Iterations between position updates.
+    };
+
+    /**
+     * @brief Quadtree cell.
+     */
+    struct Cell {
+        sf::Vector2f origin;        ///< @brief Top-left corner of the cell.
+        float size;                 ///< @brief Width/height of the cell.
+        sf::Vector2f center;        ///< @brief Center of mass of the nodes in the cell.
+        float mass;                 ///< @brief Number of nodes in the cell.
+        uint32_t begin, end;        ///< @brief Range of nodes in the cell, in ForceLayout::order.
+        int32_t children[4];        ///< @brief Indices of child cells, or -1; all -1 in leaves.
+    };
+
+    /**
+     * @brief Graph at one level of coarsening.
+     */
+    struct Level {
+        std::vector<uint32_t> adjacencyBegin;   ///< @brief Start of the neighbours of each node in adjacency.
+        std::vector<uint32_t> adjacency;        ///< @brief Neighbours of all nodes.
+        std::vector<uint32_t> parent;           ///< @brief Node of the next level each node was collapsed into.
+
+        size_t size() const { return adjacencyBegin.size()-1; }
+    };
+
+    static const uint32_t LEAF_SIZE = 8;            ///< @brief Maximum number of nodes in a leaf.
+    static const size_t COARSEST_SIZE = 50;         ///< @brief Number of nodes below which the graph is not coarsened.
+    static constexpr float COARSENING_RATIO = 0.8f; ///< @brief Coarsening stops if it does not shrink the graph below this ratio.
+    static const unsigned RANDOM_SEED = 42;         ///< @brief Seed of random initial positions, so layouts are reproducible.
+    static const int MAX_DEPTH = 24;                ///< @brief Maximum depth of the quadtree.
+    static constexpr float REPULSION = 0.2f;        ///< @brief Strength of repulsion relative to attraction.
+    static constexpr float STEP_FACTOR = 0.9f;      ///< @brief Factor the step length is adapted by.
+    static constexpr float MIN_STEP = 0.01f;        ///< @brief Step length, relative to edge length, below which a level is considered converged.
+    static constexpr float FINE_STEP = 0.2f;        ///< @brief Initial step length, relative to edge length, when refining a layout.
+
+    GraphViewer &graph;                     ///< @brief Graph being laid out.
+
+    unsigned iterations = 300;              ///< @brief Maximum number of iterations of the coarsest level.
+    unsigned refinementIterations = 100;    ///< @brief Maximum number of iterations of finer levels.
+    float edgeLength = 100.0f;              ///< @brief Ideal edge length, in pixels.
+    float theta = 1.0f;                     ///< @brief Barnes-Hut opening angle.
+    float gravity = 0.05f;                  ///< @brief Strength of pull to the center.
+    unsigned threads = 0;                   ///< @brief Number of threads, or 0 for all hardware threads.
+    unsigned updateInterval = 10;           ///< @brief Iterations between position updates, or 0.
+
+    std::thread worker;                     ///< @brief Thread running the layout.
+    std::atomic<bool> running{false};       ///< @brief True while the layout runs.
+    std::atomic<bool> cancelled{false};     ///< @brief True if the layout was asked to stop.
+    std::atomic<unsigned> iteration{0};     ///< @brief Number of completed iterations.
+    std::exception_ptr exception;           ///< @brief Exception thrown by the worker.
+
+    std::vector<GraphViewer::id_t> ids;     ///< @brief IDs of nodes.
+    std::vector<Level> levels;              ///< @brief Coarsening levels; the first is the graph itself.
+    size_t currentLevel = 0;                ///< @brief Level being laid out.
+    std::vector<uint32_t> ancestors;        ///< @brief Node of the current level each node of the graph was collapsed into.
+    std::vector<sf::Vector2f> positions;    ///< @brief Positions of nodes of the current level.
+    std::vector<sf::Vector2f> forces;       ///< @brief Displacements computed in the current iteration.
+    std::vector<uint32_t> order;            ///< @brief Nodes sorted by quadtree cell.
+    std::vector<Cell> cells;                ///< @brief Quadtree cells; the root is the first.
+
+    /**
+     * @brief Copy nodes and edges from the graph.
+     */
+    void load();
+
+    /**
+     * @brief Build adjacency lists of a level.
+     *
+     * @param level     Level
+     * @param n         Number of nodes
+     * @param ends      Endpoints of edges, smallest first; sorted and
+     *                  deduplicated in place
+     */
+    static void makeAdjacency(Level &level, size_t n, std::vector<std::pair<uint32_t, uint32_t>> &ends);
+
+    /**
+     * @brief Add a coarser level, by collapsing a maximal matching of the
+     *        edges of the coarsest level.
+     *
+     * @param rng       Random number generator
+     * @return true     If a level was added
+     * @return false    If the graph could not be coarsened enough
+     */
+    bool coarsen(std::mt19937 &rng);
+
+    /**
+     * @brief Get bounding box of the current positions.
+     *
+     * @param lo        Minimum coordinates
+     * @param hi        Maximum coordinates
+     */
+    void bounds(sf::Vector2f &lo, sf::Vector2f &hi) const;
+
+    /**
+     * @brief Run all iterations; body of the worker thread.
+     *
+     * @param p     Parameters
+     */
+    void work(Parameters p);
+
+    /**
+     * @brief Build the quadtree of current positions.
+     */
+    void buildTree();
+
+    /**
+     * @brief Build a quadtree cell and its descendants.
+     *
+     * @param begin     Start of the nodes in the cell, in order
+     * @param end       End of the nodes in the cell, in order
+     * @param origin    Top-left corner of the cell
+     * @param size      Width/height of the cell
+     * @param depth     Depth of the cell
+     * @return int32_t  Index of the cell
+     */
+    int32_t buildCell(uint32_t begin, uint32_t end, const sf::Vector2f &origin, float size, int depth);
+
+    /**
+     * @brief Compute the displacements of a range of nodes.
+     *
+     * @param begin     Start of the range, in order
+     * @param end       End of the range, in order
+     * @param p         Parameters
+     */
+    void computeForces(uint32_t begin, uint32_t end, const Parameters &p);
+
+    /**
+     * @brief Write current positions to the graph, scaled so the average
+     *        edge has the ideal length.
+     *
+     * @param p         Parameters
+     */
+    void commit(const Parameters &p);
+
+public:
+    /**
+     * @brief Construct a new ForceLayout.
+     *
+     * @param graph     Graph to lay out
+     */
+    explicit ForceLayout(GraphViewer &graph);
+
+    ForceLayout(const ForceLayout&) = delete;
+    ForceLayout& operator=(const ForceLayout&) = delete;
+
+    /**
+     * @brief Cancel the layout if it is running, and wait for it to stop.
+     */
+    ~ForceLayout();
+
+    /**
+     * @brief Set maximum number of iterations of the coarsest level (or of
+     *        the graph, when refining a layout).
+     *
+     * Each level ends earlier if it converges.
+     *
+     * Changes to parameters take effect the next time the layout starts.
+     *
+     * @param n     Number of iterations
+     */
+    void setIterations(unsigned n = 300);
+
+    /**
+     * @brief Set maximum number of iterations of each level finer than the
+     *        coarsest.
+     *
+     * These levels start from an almost final layout, so they need fewer
+     * iterations; most of the time of a layout is spent on the finest ones.
+     *
+     * @param n     Number of iterations
+     */
+    void setRefinementIterations(unsigned n = 100);
+
+    /**
+     * @brief Set ideal edge length.
+     *
+     * @param length    Length, in pixels
+     */
+    void setEdgeLength(float length = 100.0f);
+
+    /**
+     * @brief Set Barnes-Hut opening angle.
+     *
+     * A group of nodes is approximated by its center of mass if its width
+     * divided by its distance is less than theta. Larger values are faster
+     * but less precise; 0 computes all pairs of nodes exactly.
+     *
+     * @param theta     Opening angle
+     */
+    void setTheta(float theta = 1.0f);
+
+    /**
+     * @brief Set strength of the pull of all nodes to their center, which
+     *        keeps disconnected parts of the graph close together.
+     *
+     * @param gravity   Strength; 0 disables it
+     */
+    void setGravity(float gravity = 0.05f);
+
+    /**
+     * @brief Set number of threads used to compute forces.
+     *
+     * Forces are computed by the process-wide WorkerPool, so at most as
+     * many threads as the hardware supports are used.
+     *
+     * @param threads   Number of threads, or 0 to use all hardware threads
+     */
+    void setThreads(unsigned threads = 0);
+
+    /**
+     * @brief Set number of iterations between writing positions to the graph.
+     *
+     * @param n     Number of iterations, or 0 to only write positions when
+     *              the layout ends
+     */
+    void setUpdateInterval(unsigned n = 10);
+
+    /**
+     * @brief Start the layout in a background thread.
+     *
+     * @throws std::logic_error     If the layout is already running
+     */
+    void start();
+
+    /**
+     * @brief Ask the layout to stop after the current iteration.
+     *
+     * Positions reached so far are written to the graph.
+     */
+    void cancel();
+
+    /**
+     * @brief Wait for the layout to end.
+     *
+     * @throws  Any exception thrown while writing positions to the graph
+     *          (e.g., std::out_of_range if a node was removed)
+     */
+    void join();
+
+    /**
+     * @brief Run the layout and wait for it to end.
+     *
+     * @see ForceLayout::start()
+     * @see ForceLayout::join()
+     */
+    void run();
+
+    /**
+     * @brief Check if the layout is running.
+     *
+     * @return true     If it is running
+     * @return false    Otherwise
+     */
+    bool isRunning() const;
+
+    /**
+     * @brief Get number of completed iterations of the current (or last) run.
+     *
+     * @return unsigned     Number of iterations
+     */
+    unsigned getIteration() const;
+};
+
+#endif // FORCE_LAYOUT_H_INCLUDED
@@ -1,60 +1,141 @@
 #ifndef FPS_MONITOR_H_INCLUDED
 #define FPS_MONITOR_H_INCLUDED
 
+#include <array>
 #include <chrono>
-#include <queue>
+#include <cstddef>
 
 /**
- * @brief Class to monitor number of frames per second.
+ * @brief Class to monitor number of frames per second and frame times.
+ *
+ * Frame timestamps and times in the past Dt interval are kept in
+ * fixed-capacity ring buffers, so counting a frame never allocates memory.
+ * Besides the average number of frames per second, it reports the
+ * distribution of frame times in that interval, which reveals occasional
+ * slow frames that the average hides.
+ *
+ * Frame times are measured by the caller, rather than taken as the time
+ * between consecutive frames, so time spent idle between frames (e.g.,
+ * waiting for a redraw to be requested) is not counted as a slow frame.
  */
 class FPSMonitor {
+public:
+    typedef std::chrono::high_resolution_clock clock;
+
+    static const size_t CAPACITY = 4096;            ///< @brief Maximum number of frames kept.
+    static const size_t HISTOGRAM_BUCKETS = 8;      ///< @brief Number of buckets of the frame time histogram.
+
+    /**
+     * @brief Distribution of frame times over the interval.
+     *
+     * Times are in milliseconds.
+     */
+    struct Statistics {
+        size_t frames = 0;      ///< @brief Number of frame times measured.
+        float min = 0.0f;       ///< @brief Shortest frame time.
+        float avg = 0.0f;       ///< @brief Average frame time.
+        float p50 = 0.0f;       ///< @brief Median frame time.
+        float p95 = 0.0f;       ///< @brief 95th percentile of frame times.
+        float p99 = 0.0f;       ///< @brief 99th percentile of frame times.
+        float max = 0.0f;       ///< @brief Longest frame time.
+        /**
+         * @brief Number of frame times in each bucket.
+         *
+         * @see FPSMonitor::getHistogramLimit(size_t)
+         */
+        std::array<unsigned, HISTOGRAM_BUCKETS> histogram{};
+    };
+
 private:
     /**
-     * @brief Queue with all frame timestamps in the past Dt interval
+     * @brief Ring buffer with the frame timestamps in the past Dt interval
      */
-    std::queue<std::chrono::high_resolution_clock::time_point> q;
+    std::array<clock::time_point, CAPACITY> q;
+    std::array<float, CAPACITY> frameTimes; ///< @brief Frame times, in the same ring buffer positions as q.
+    size_t head = 0;    ///< @brief Index of the oldest timestamp.
+    size_t size = 0;    ///< @brief Number of timestamps.
     /**
      * @brief Time interval to save frame timestamps
      */
-    std::chrono::high_resolution_clock::duration Dt;
+    clock::duration Dt;
+
+    /**
+     * @brief Get a timestamp.
+     *
+     * @param i     Index, from the oldest (0) to the newest (size-1)
+     * @return const clock::time_point&   Timestamp
+     */
+    const clock::time_point& at(size_t i) const;
+
+    /**
+     * @brief Get number of the oldest timestamps that are out of the interval.
+     *
+     * Frames are only removed when one is counted, so the getters skip these
+     * to not report stale frames while no frames are drawn.
+     *
+     * @param now       Current time
+     * @return size_t   Number of timestamps older than now-Dt
+     */
+    size_t expired(clock::time_point now) const;
 public:
     /**
      * @brief Construct a new FPSMonitor object
-     * 
+     *
      * You can specify the time interval (in milliseconds) the FPSMonitor uses
      * to determine the number of frames per second.
-     * 
+     *
      * If the interval is longer, it takes more time to stabilize at the
      * beginning and when there is a change in actual FPS, but the reading is
      * more exact once it stabilizes.
-     * 
+     *
      * If the interval is shorter, readings are not as exact but they stabilize
      * faster.
-     * 
+     *
      * We advise you use an interval around 1000ms.
-     * 
+     *
      * @param ms Time interval in milliseconds
      */
     explicit FPSMonitor(int ms);
 
     /**
      * @brief Set the time interval
-     * 
+     *
      * @param ms Time interval in milliseconds
      */
     void setInterval(int ms);
 
     /**
      * @brief Count a frame.
+     *
+     * @param frameTime Time taken to draw the frame, in milliseconds
      */
-    void count();
+    void count(float frameTime);
 
     /**
      * @brief Get number of frames per second over the specified interval.
-     * 
+     *
      * @return Frames Per Second
      */
     float getFPS() const;
+
+    /**
+     * @brief Get distribution of frame times over the specified interval.
+     *
+     * @return Statistics   Frame time statistics; all zero if no frames were
+     *                      counted in the interval
+     */
+    Statistics getStatistics() const;
+
+    /**
+     * @brief Get upper limit of a histogram bucket.
+     *
+     * Bucket i holds frame times from the limit of bucket i-1 (or 0) up to,
+     * but excluding, its own limit; the last bucket has no upper limit.
+     *
+     * @param i         Bucket index
+     * @return float    Limit, in milliseconds; infinity for the last bucket
+     */
+    static float getHistogramLimit(size_t i);
 };
 
 #endif // FPS_MONITOR_H_INCLUDED
@@ -1,17 +1,27 @@
 #ifndef GRAPH_VIEWER_H
 #define GRAPH_VIEWER_H
 
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <thread>
 #include <mutex>
 #include <unordered_map>
-#include <set>
+#include <map>
+#include <memory>
+#include <vector>
 
 #include "fpsmonitor.h"
+#include "idindex.h"
+#include "objectpool.h"
+#include "spatialgrid.h"
+#include "texturecache.h"
 
 #include <SFML/Graphics.hpp>
 #include <condition_variable>
 
+class RenderScheduler;
+
 /**
  * @brief Class to save and represent a graph.
  */
@@ -34,21 +44,376 @@ public:
     static const Color LIGHT_GRAY;
     static const Color DARK_GRAY ;
 
+    friend class RenderScheduler;
+
 private:
     class LineShape;
     class FullLineShape;
     class DashedLineShape;
     class ArrowHead;
+    class LineBatch;
 
 public:
+    class Node;
     class Edge;
 
+    /**
+     * @brief Statistics of a frame drawn in the window.
+     *
+     * Times are in milliseconds. Vertices of shapes and unzipped labels are
+     * estimated from their point and character counts.
+     *
+     * @see GraphViewer::getFrameStats()
+     */
+    struct FrameStats {
+        float frameTime   = 0.0f;   ///< @brief Total time of the frame.
+        float eventsTime  = 0.0f;   ///< @brief Time handling window events.
+        float lockTime    = 0.0f;   ///< @brief Time waiting to lock the graph.
+        float prepareTime = 0.0f;   ///< @brief Time applying deferred updates, finding visible elements, copying the snapshot and drawing the background.
+        float edgesTime   = 0.0f;   ///< @brief Time drawing edges.
+        float nodesTime   = 0.0f;   ///< @brief Time drawing nodes.
+        float labelsTime  = 0.0f;   ///< @brief Time drawing labels.
+        float displayTime = 0.0f;   ///< @brief Time displaying the frame, including waiting for vertical sync or the framerate limit.
+        unsigned drawCalls = 0;     ///< @brief Number of draw calls.
+        size_t vertices = 0;        ///< @brief Number of vertices drawn.
+        size_t visibleNodes = 0;    ///< @brief Number of nodes considered for drawing (inside the view, if culling).
+        size_t totalNodes = 0;      ///< @brief Number of nodes in the graph.
+        size_t visibleEdges = 0;    ///< @brief Number of edges considered for drawing (inside the view, if culling).
+        size_t totalEdges = 0;      ///< @brief Number of edges in the graph.
+    };
+
+private:
+    /**
+     * @brief Class to save zipped edges.
+     *
+     * Zipped edges are kept in a persistent vertex buffer, where each edge
+     * owns a slot (a range of vertices) that is patched in place whenever
+     * the edge changes. Released slots are reused by edges with the same
+     * vertex count; once most of the buffer is wasted it should be rebuilt
+     * with GraphViewer::updateZip().
+     *
+     * Only works properly with vertex arrays meant to be drawn as sf::Quads.
+     */
+    class ZipEdges {
+    public:
+        /**
+         * @brief Range of vertices owned by an edge.
+         */
+        struct Slot {
+            size_t offset = 0;                  ///< @brief Index of the first vertex of the slot.
+            size_t length = 0;                  ///< @brief Number of vertices in the slot; 0 if there is no slot.
+        };
+    private:
+        std::vector<sf::Vertex> vertices;       ///< @brief Vertices vector, the zipped version of several vertex arrays
+        std::unordered_map<size_t, std::vector<size_t>> freeSlots; ///< @brief Offsets of released slots, by slot length.
+        size_t freeVertices = 0;                ///< @brief Number of vertices in released slots.
+        unsigned long version = 0;              ///< @brief Incremented whenever vertices change.
+
+        /**
+         * @brief Get a slot with a given length, reusing a released one if possible.
+         *
+         * @param length    Number of vertices
+         * @return Slot     New slot
+         */
+        Slot allocate(size_t length);
+    public:
+        /**
+         * @brief Write vertex array to a slot.
+         *
+         * If the slot is too small it is released and a new one is allocated;
+         * if it is larger than needed, the remaining vertices are cleared.
+         *
+         * @param slot  Slot to write to; updated if it has to be reallocated
+         * @param a     Vertex array to write, or nullptr to release the slot
+         */
+        void write(Slot &slot, const sf::VertexArray *a);
+        /**
+         * @brief Release slot, so it is not drawn and can be reused.
+         *
+         * @param slot  Slot to be released; it is reset to an empty slot
+         */
+        void release(Slot &slot);
+        /**
+         * @brief Check if most of the vertex buffer is made of released slots.
+         *
+         * @return true     If the buffer should be compacted
+         * @return false    Otherwise
+         */
+        bool isFragmented() const;
+        /**
+         * @brief Clear all vertices and slots.
+         */
+        void clear();
+        /**
+         * @brief Get vertex vector.
+         * 
+         * @return const std::vector<sf::Vertex>& Vertex vector to be drawn.
+         */
+        const std::vector<sf::Vertex>& getVertices() const;
+        /**
+         * @brief Get version of the vertices, which changes whenever they do.
+         *
+         * @return unsigned long    Version
+         */
+        unsigned long getVersion() const;
+    };
+
+    /**
+     * @brief Class to save zipped nodes.
+     *
+     * Nodes are packed into one vertex array per texture, so all nodes can be
+     * drawn with one draw call per distinct texture. Circle nodes are drawn
+     * as two textured quads (outline and fill) over a shared pre-rasterized
+     * disc texture; icon nodes are drawn as one quad with their icon, grouped
+     * by icon texture.
+     *
+     * As with ZipEdges, each node owns a slot that is patched in place when
+     * the node changes.
+     */
+    class ZipNodes {
+    public:
+        /**
+         * @brief Vertices owned by a node.
+         */
+        struct Slot {
+            const sf::Texture *texture = nullptr;   ///< @brief Texture of the batch the slot is in.
+            size_t offset = 0;                      ///< @brief Index of the first vertex of the slot.
+            bool used = false;                      ///< @brief True if the slot is in use.
+        };
+    private:
+        static const unsigned DISC_SIZE = 128;      ///< @brief Width/height of the disc texture, in pixels.
+
+        /**
+         * @brief Vertices of all nodes that use the same texture.
+         */
+        struct Batch {
+            std::vector<sf::Vertex> vertices;       ///< @brief Vertices of the batch.
+            std::vector<size_t> freeOffsets;        ///< @brief Offsets of released slots.
+            size_t count = 0;                       ///< @brief Number of slots in use.
+        };
+        sf::Texture *disc = nullptr;                ///< @brief Disc texture, created when first drawn.
+        Batch circles;                              ///< @brief Batch of circle nodes (drawn with disc texture).
+        std::unordered_map<const sf::Texture*, Batch> icons; ///< @brief Batches of icon nodes, by icon texture.
+
+        /**
+         * @brief Get batch of a texture.
+         *
+         * @param texture   Icon texture, or nullptr for circle nodes
+         * @return Batch&   Batch
+         */
+        Batch& getBatch(const sf::Texture *texture);
+    public:
+        ZipNodes() = default;
+        ZipNodes(const ZipNodes &) = delete;
+        ZipNodes& operator=(const ZipNodes &) = delete;
+        ~ZipNodes();
+
+        /**
+         * @brief Write node to a slot.
+         *
+         * The slot is moved to another batch if the node texture changed.
+         *
+         * @param slot  Slot to write to; updated if it has to be reallocated
+         * @param node  Node to write, or nullptr to release the slot
+         */
+        void write(Slot &slot, const Node *node);
+        /**
+         * @brief Release slot, so it is not drawn and can be reused.
+         *
+         * @param slot  Slot to be released; it is reset to an unused slot
+         */
+        void release(Slot &slot);
+        /**
+         * @brief Clear all batches.
+         */
+        void clear();
+        /**
+         * @brief Write the vertices of a circle node.
+         *
+         * @param node  Node, which must not be an icon
+         * @param v     Destination of the 8 vertices (outline and fill quads),
+         *              to be drawn with the disc texture
+         */
+        static void writeCircle(const Node &node, sf::Vertex *v);
+        /**
+         * @brief Get disc texture, creating it if needed.
+         *
+         * @return const sf::Texture&   Disc texture
+         */
+        const sf::Texture& getDisc();
+        /**
+         * @brief Draw circle nodes batch.
+         *
+         * @param target    Render target to draw to
+         * @param stats     Statistics of the frame being drawn
+         */
+        void drawCircles(sf::RenderTarget &target, FrameStats &stats);
+        /**
+         * @brief Draw icon nodes batches.
+         *
+         * @param target    Render target to draw to
+         * @param stats     Statistics of the frame being drawn
+         */
+        void drawIcons(sf::RenderTarget &target, FrameStats &stats);
+        /**
+         * @brief Draw all batches.
+         *
+         * @param target    Render target to draw to
+         * @param stats     Statistics of the frame being drawn
+         */
+        void draw(sf::RenderTarget &target, FrameStats &stats);
+    };
+
+    /**
+     * @brief Copy of the geometry of a frame, drawn without holding graphMutex.
+     *
+     * Only holds geometry that does not depend on textures owned by nodes or
+     * fonts, which can be changed by other threads while it is drawn.
+     */
+    struct FrameSnapshot {
+        std::vector<sf::Vertex> edges;          ///< @brief Edge vertices.
+        sf::PrimitiveType edgesType = sf::Quads;///< @brief Primitive type of edge vertices.
+        std::vector<sf::Vertex> nodes;          ///< @brief Circle node vertices.
+        sf::PrimitiveType nodesType = sf::Quads;///< @brief Primitive type of circle node vertices.
+        const sf::Texture *nodesTexture = nullptr; ///< @brief Texture of circle node vertices, if any.
+        std::vector<sf::Vertex> dashedEdges;    ///< @brief Vertices of textured dashed edges, as sf::Quads.
+        std::shared_ptr<const sf::Texture> dashTexture; ///< @brief Dash pattern texture of textured dashed edges; kept alive while drawn.
+        bool zipped = false;                    ///< @brief True if edges are copies of the zipped edges.
+        unsigned long edgesVersion = 0;         ///< @brief Version of GraphViewer::zip that edges are a copy of.
+        unsigned long dashedEdgesVersion = 0;   ///< @brief Version of GraphViewer::dashZip that dashedEdges are a copy of.
+
+        /**
+         * @brief Free all geometry.
+         */
+        void clear();
+
+        /**
+         * @brief Draw snapshot edges.
+         *
+         * @param target    Render target to draw to
+         * @param stats     Statistics of the frame being drawn
+         */
+        void drawEdges(sf::RenderTarget &target, FrameStats &stats) const;
+        /**
+         * @brief Draw snapshot nodes.
+         *
+         * @param target    Render target to draw to
+         * @param stats     Statistics of the frame being drawn
+         */
+        void drawNodes(sf::RenderTarget &target, FrameStats &stats) const;
+    };
+
+    /**
+     * @brief Working state of drawing the graph once.
+     *
+     * Each render (window frames, and renders to images) owns one, as window
+     * frames drawn from a snapshot unlock graphMutex halfway, and another
+     * thread may render to an image meanwhile.
+     */
+    struct RenderPass {
+        std::vector<Node*> visibleNodes;        ///< @brief Nodes to be drawn.
+        std::vector<Edge*> visibleEdges;        ///< @brief Edges to be drawn.
+        unsigned long visibleRemovals = 0;      ///< @brief Value of removals when visible nodes/edges were found.
+        float edgeMinLength = 0.0;              ///< @brief Minimum length of edges drawn as lines, in graph pixels.
+        std::vector<sf::Vertex> lodVertices;    ///< @brief Vertices of points/lines in reduced level of detail.
+    };
+
+    /**
+     * @brief Largest of the sizes of a set of elements, which can change
+     *        or be removed.
+     *
+     * Sizes are counted by value, as graphs usually have few distinct sizes,
+     * so the largest can be found again when its last element shrinks or is
+     * removed.
+     */
+    class MaxSize {
+    private:
+        std::map<float, size_t> counts;         ///< @brief Number of elements with each (positive) size.
+    public:
+        /**
+         * @brief Change the size of an element.
+         *
+         * @param recorded  Size the element currently counts with, or 0 if
+         *                  none; set to size
+         * @param size      New size of the element, or 0 to not count it
+         */
+        void set(float &recorded, float size);
+        /**
+         * @brief Get largest size.
+         *
+         * @return float    Largest size, or 0 if no element is counted
+         */
+        float get() const;
+        /**
+         * @brief Stop counting all elements.
+         */
+        void clear();
+    };
+
+    /**
+     * @brief Class to save zipped labels.
+     *
+     * All labels are laid out into one vertex array per font and character
+     * size (a page), using the glyphs each font already keeps in its texture
+     * atlas, so each page is drawn with a single draw call. Pages are only
+     * rebuilt after being invalidated.
+     */
+    class ZipLabels {
+    private:
+        typedef std::pair<const sf::Font*, unsigned> PageKey;  ///< @brief Font and character size of a page.
+        std::map<PageKey, std::vector<sf::Vertex>> pages;      ///< @brief Glyph vertices of each page.
+        size_t vertexCount = 0;                 ///< @brief Total number of glyph vertices.
+        bool dirty = true;                      ///< @brief True if pages must be rebuilt.
+    public:
+        /**
+         * @brief Mark pages to be rebuilt.
+         */
+        void invalidate();
+        /**
+         * @brief Check if pages must be rebuilt.
+         *
+         * @return true     If pages were invalidated since the last rebuild
+         * @return false    Otherwise
+         */
+        bool isDirty() const;
+        /**
+         * @brief Clear all pages, to start a rebuild.
+         */
+        void clear();
+        /**
+         * @brief Lay out text and append it to its page.
+         *
+         * @param text  Text to append; only position, font, character size,
+         *              bold style and fill color are considered
+         */
+        void append(const sf::Text &text);
+        /**
+         * @brief Finish a rebuild.
+         */
+        void validate();
+        /**
+         * @brief Draw all pages.
+         *
+         * @param target    Render target to draw to
+         * @param stats     Statistics of the frame being drawn
+         */
+        void draw(sf::RenderTarget &target, FrameStats &stats) const;
+        /**
+         * @brief Get total number of glyph vertices.
+         *
+         * @return size_t   Number of vertices
+         */
+        size_t getVertexCount() const;
+    };
+
+public:
     /**
      * @brief Class to represent a node.
      */
     class Node {
         friend Edge;
         friend GraphViewer;
+        friend ObjectPool<Node>;
     private:
         static float defaultSize;                   ///< @brief Default node size.
     public:
@@ -73,34 +438,77 @@ public:
          */
         static float getDefaultSize();
     private:
+        GraphViewer *graph;                         ///< @brief Graph the node belongs to.
         id_t id;                                    ///< @brief Node ID.
         sf::Vector2f position;                      ///< @brief Node position.
         float size = defaultSize;                   ///< @brief Node size.
         std::string label;                          ///< @brief Node label.
         sf::Color color = sf::Color::Red;           ///< @brief Node color.
-        sf::Texture icon;                           ///< @brief Node icon.
+        TextureCache::Handle icon;                  ///< @brief Node icon.
+        std::string iconPath;                       ///< @brief Path of node icon file.
         bool isIcon = false;                        ///< @brief True if node is icon, false otherwise.
         float outlineThickness = 1.0;               ///< @brief Node outline thickness.
         sf::Color outlineColor = sf::Color::Black;  ///< @brief Node outline color.
         sf::Shape *shape = nullptr;                 ///< @brief Node shape.
         sf::Text text;                              ///< @brief Node text.
         bool enabled = true;                        ///< @brief Enabled state of node.
+        bool dirty = false;                         ///< @brief True if node is waiting for a deferred update.
+        ZipNodes *zip = nullptr;                    ///< @brief Zipped nodes object the node is written to, or nullptr if not zipped.
+        ZipNodes::Slot zipSlot;                     ///< @brief Slot of the node in the zipped nodes object.
+        bool labelZipped = false;                   ///< @brief True if node label is in the zipped labels.
+        float lodSize = 0.0;                        ///< @brief Size the node counts with in GraphViewer::nodeSizes.
+        float lodLabelSize = 0.0;                   ///< @brief Size the node label counts with in GraphViewer::labelSizes.
 
-        std::set<Edge*> edges;
+        std::vector<Edge*> edges;                   ///< @brief Edges connected to the node; self-loops appear once.
 
         /**
-         * @brief Update node shape and text considering changes in properties.
+         * @brief Update node shape and text, and the edges connected to it,
+         *        considering changes in properties.
          */
         void update();
 
+        /**
+         * @brief Update node shape and text only.
+         */
+        void updateShape();
+
+        /**
+         * @brief Write node to its slot in the zipped nodes object, if any.
+         */
+        void updateZip();
+
+        /**
+         * @brief Get bounding box of node shape and text.
+         *
+         * @return sf::FloatRect    Bounding box, in pixels
+         */
+        sf::FloatRect getBounds() const;
+
+        /**
+         * @brief Signal that a property changed.
+         *
+         * Updates the node immediately, or marks it dirty if the graph has
+         * deferred updates enabled.
+         *
+         * @see GraphViewer::setDeferredUpdates(bool)
+         */
+        void invalidate();
+
     private:
         /**
          * @brief Construct a new Node object with ID and position
          * 
+         * @param graph     Graph the node belongs to
          * @param id        Unique node ID
          * @param position  Node position in the window, in pixels
          */
-        explicit Node(id_t id, const sf::Vector2f &position);
+        explicit Node(GraphViewer &graph, id_t id, const sf::Vector2f &position);
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+        /**
+         * @brief Destroy the Node object, freeing its shape.
+         */
+        ~Node();
     
     public:
         /**
@@ -109,6 +517,24 @@ public:
          * @return id_t     Node ID
          */
         id_t getId() const;
+
+        /**
+         * @brief Get edges connected to the node, in no particular order.
+         *
+         * Self-loops appear once. The reference remains valid while the node
+         * exists, but the contents change when edges connected to the node
+         * are added or removed.
+         *
+         * @return const std::vector<Edge*>&    Connected edges
+         */
+        const std::vector<Edge*>& getEdges() const;
+
+        /**
+         * @brief Get number of edges connected to the node.
+         *
+         * @return size_t   Number of edges
+         */
+        size_t getDegree() const;
         
         /**
          * @brief Set node position.
@@ -198,16 +624,30 @@ public:
         
         /**
          * @brief Set node icon.
+         *
+         * Icons are loaded through TextureCache, so nodes with the same icon
+         * share the same texture.
          * 
-         * @param path  Path of file to be used as icon
+         * @param path  Path of file to be used as icon, or empty to clear it
+         *
+         * @throws std::runtime_error   If the file could not be loaded
          */
         void setIcon(const std::string &path);
         /**
          * @brief Get node icon texture.
+         *
+         * The texture may hold other images besides the icon, if it is an
+         * atlas; see getIconRect().
          * 
          * @return const sf::Texture& Icon texture
          */
         const sf::Texture& getIcon() const;
+        /**
+         * @brief Get region of the icon texture holding the icon.
+         *
+         * @return sf::IntRect  Region, in pixels
+         */
+        sf::IntRect getIconRect() const;
         /**
          * @brief Check if node is an icon.
          * 
@@ -280,6 +720,7 @@ public:
     class Edge {
         friend Node;
         friend GraphViewer;
+        friend ObjectPool<Edge>;
     public:
         /**
          * @brief Edge type.
@@ -289,6 +730,7 @@ public:
             UNDIRECTED      ///< @brief Undirected edge
         };
     private:
+        GraphViewer *graph;                 ///< @brief Graph the edge belongs to.
         id_t id;                            ///< @brief Edge ID.
         Node *u = nullptr;                  ///< @brief Edge origin node.
         Node *v = nullptr;                  ///< @brief Edge destination node.
@@ -297,28 +739,126 @@ public:
         sf::Color color = sf::Color::Black; ///< @brief Edge color.
         bool dashed = false;                ///< @brief True if edge is dashed, false if full.
         float thickness = 5.0;              ///< @brief Edge thickness, in pixels.
-        float *weight = nullptr;            ///< @brief Edge weight.
-        float *flow = nullptr;              ///< @brief Edge flow.
+        bool hasWeight = false;             ///< @brief True if edge has a weight.
+        bool hasFlow = false;               ///< @brief True if edge has a flow.
+        float weight = 0.0;                 ///< @brief Edge weight, if hasWeight.
+        float flow = 0.0;                   ///< @brief Edge flow, if hasFlow.
+        sf::Color labelColor = sf::Color::Black;            ///< @brief Edge label color.
+        unsigned labelSize = GraphViewer::FONT_SIZE;        ///< @brief Edge label character size.
         LineShape *shape = nullptr;         ///< @brief Edge shape.
-        sf::Text text;                      ///< @brief Edge text.
+        std::unique_ptr<sf::Text> text;     ///< @brief Edge text, or nullptr if the edge has no label, weight or flow.
+        mutable bool textDirty = false;     ///< @brief True if edge text must be laid out before it is used.
         bool enabled = true;                ///< @brief Enabled state of edge.
+        bool dirty = false;                 ///< @brief True if edge is waiting for a deferred update.
+        ZipEdges *zip = nullptr;            ///< @brief Zipped edges object the edge is written to, or nullptr if not zipped.
+        ZipEdges::Slot zipSlot;             ///< @brief Slot of the edge in the zipped edges object.
+        bool labelZipped = false;           ///< @brief True if edge label is in the zipped labels.
+        float lodThickness = 0.0;           ///< @brief Thickness the edge counts with in GraphViewer::edgeThicknesses.
+        float lodLabelSize = 0.0;           ///< @brief Size the edge label counts with in GraphViewer::labelSizes.
+        size_t uIndex = 0;                  ///< @brief Index of the edge in the edges of its origin node.
+        size_t vIndex = 0;                  ///< @brief Index of the edge in the edges of its destination node, unless it is a self-loop.
+
+        /**
+         * @brief Add edge to the edges of its endpoints.
+         */
+        void attach();
+
+        /**
+         * @brief Remove edge from the edges of its endpoints, in constant
+         *        time, by moving the last edge of each node into its place.
+         */
+        void detach();
 
         /**
          * @brief Update edge shape and text considering changes in properties.
          */
         void update();
 
+        /**
+         * @brief Update edge shape only.
+         *
+         * Only reads the edge and its nodes, so shapes of different edges can
+         * be updated in parallel.
+         */
+        void updateShape();
+
+        /**
+         * @brief Set edge shape from precomputed vertex positions, instead of
+         *        computing it.
+         *
+         * Textured dashed edges compute their shape instead, as precomputed
+         * geometry has no texture coordinates.
+         *
+         * @param positions Vertex positions, as x/y pairs, of sf::Quads
+         * @param n         Number of vertices
+         */
+        void setShape(const float *positions, size_t n);
+
+        /**
+         * @brief Update edge text only.
+         *
+         * Only creates or destroys the text object as needed; its contents
+         * and position are laid out when the text is next used.
+         */
+        void updateText();
+
+        /**
+         * @brief Lay out edge text, if it changed since it was last laid out.
+         */
+        void layoutText() const;
+
+        /**
+         * @brief Update the structures of the graph that depend on the edge
+         *        shape and text (zipped edges and labels, spatial index).
+         */
+        void updateGraph();
+
+        /**
+         * @brief Write edge shape to its slot in the zipped edges object, if any.
+         *
+         * Moves the slot to the zip of textured dashes, or back, if needed.
+         */
+        void updateZip();
+
+        /**
+         * @brief Get bounding box of edge shape and text.
+         *
+         * Does not lay out the text; if it is not laid out, its bounds are
+         * estimated from the number of characters and the label size.
+         *
+         * @return sf::FloatRect    Bounding box, in pixels
+         */
+        sf::FloatRect getBounds() const;
+
+        /**
+         * @brief Signal that a property changed.
+         *
+         * Updates the edge immediately, or marks it dirty if the graph has
+         * deferred updates enabled.
+         *
+         * @see GraphViewer::setDeferredUpdates(bool)
+         */
+        void invalidate();
+
     private:
         /**
          * @brief Construct a new Edge object with ID, origin/destination nodes
          *        and direction.
          * 
+         * The edge belongs to the same graph as its origin node.
+         * 
          * @param id            Unique edge ID
          * @param u             Pointer to origin node
          * @param v             Pointer to destination node
          * @param edge_type     Edge type (directed or undirected)
          */
         explicit Edge(id_t id, Node &u, Node &v, EdgeType edge_type = UNDIRECTED);
+        Edge(const Edge&) = delete;
+        Edge& operator=(const Edge&) = delete;
+        /**
+         * @brief Destroy the Edge object, freeing its shape and its label text, if it was created.
+         */
+        ~Edge();
         
     public:
         /**
@@ -353,6 +893,16 @@ public:
          * @return const Node*  Pointer to destination node.
          */
         const Node* getTo() const;
+        /**
+         * @brief Get the endpoint of the edge other than a given one.
+         *
+         * Allows walking the neighbours of a node through Node::getEdges().
+         *
+         * @param node          Pointer to one of the endpoints
+         * @return const Node*  Pointer to the other endpoint (node itself
+         *                      for self-loops)
+         */
+        const Node* getOpposite(const Node *node) const;
 
         /**
          * @brief Set edge type.
@@ -492,6 +1042,9 @@ public:
         /**
          * @brief Get edge text (includes label).
          * 
+         * Edges without label, weight or flow have no text object, and an
+         * empty text is returned.
+         * 
          * @return const sf::Text&  Edge text
          */
         const sf::Text& getText() const;
@@ -514,24 +1067,100 @@ public:
         bool isEnabled() const;
     };
     
-public:
-    static const int DEFAULT_WIDTH  = 800;
-    static const int DEFAULT_HEIGHT = 600;
-
     /**
-     * @brief Construct a new graph.
+     * @brief Description of a node, used to add nodes in bulk.
+     *
+     * @see GraphViewer::addNodes(const std::vector<NodeDescriptor>&)
      */
-    explicit GraphViewer();
+    struct NodeDescriptor {
+        id_t id = 0;                                ///< @brief Unique node ID.
+        sf::Vector2f position;                      ///< @brief Node position, in pixels.
+        sf::Color color = sf::Color::Red;           ///< @brief Node color.
+        float size = Node::getDefaultSize();        ///< @brief Node size, in pixels.
+        std::string label;                          ///< @brief Node label.
+        std::string icon;                           ///< @brief Path of node icon file, or empty if not an icon.
+    };
 
     /**
-     * @brief Create the visualization window.
+     * @brief Description of an edge, used to add edges in bulk.
      *
-     * @param width Window width (in pixels)
-     * @param height Window height (in pixels)
+     * @see GraphViewer::addEdges(const std::vector<EdgeDescriptor>&)
      */
-    void createWindow(unsigned int width = DEFAULT_WIDTH, unsigned int height = DEFAULT_HEIGHT);
+    struct EdgeDescriptor {
+        id_t id = 0;                                ///< @brief Unique edge ID.
+        id_t u = 0;                                 ///< @brief Unique ID of origin node.
+        id_t v = 0;                                 ///< @brief Unique ID of destination node.
+        Edge::EdgeType edge_type = Edge::EdgeType::UNDIRECTED; ///< @brief Edge type.
+        sf::Color color = sf::Color::Black;         ///< @brief Edge color.
+        float thickness = 5.0;                      ///< @brief Edge thickness, in pixels.
+        std::string label;                          ///< @brief Edge label.
+        bool dashed = false;                        ///< @brief True if edge is dashed.
+        bool hasWeight = false;                     ///< @brief True if edge has a weight.
+        float weight = 0.0;                         ///< @brief Edge weight, if hasWeight.
+        bool hasFlow = false;                       ///< @brief True if edge has a flow.
+        float flow = 0.0;                           ///< @brief Edge flow, if hasFlow.
+        /**
+         * @brief Precomputed edge shape, as x/y pairs of the vertices of
+         *        sf::Quads, or nullptr to compute it from the nodes.
+         *
+         * Must remain valid until the edge is added.
+         */
+        const float *geometry = nullptr;
+        size_t geometrySize = 0;                    ///< @brief Number of vertices in geometry.
+    };
 
-    bool isWindowOpen() const;
+    /**
+     * @brief Thresholds of the level of detail tiers.
+     *
+     * Thresholds are compared against on-screen sizes (in screen pixels) of
+     * the largest node, thickest edge and largest label currently in the
+     * graph, so a tier is only used when it affects all elements of that
+     * kind.
+     *
+     * @see GraphViewer::setLevelOfDetail(bool)
+     */
+    struct LevelOfDetail {
+        float labelMinSize      = 6.0f;             ///< @brief Labels are hidden below this character size.
+        float nodePointSize     = 2.0f;             ///< @brief Nodes are drawn as points below this size.
+        float edgeLineThickness = 1.0f;             ///< @brief Edges are drawn as 1-pixel lines, without arrowheads or dashes, below this thickness.
+        float edgeMinLength     = 1.0f;             ///< @brief Edges drawn as lines are dropped if shorter than this.
+    };
+
+    /**
+     * @brief Options to load text graph files.
+     *
+     * @see GraphViewer::loadText(const std::string&, const std::string&, const TextGraphOptions&)
+     */
+    struct TextGraphOptions {
+        float scale = 1.0f;                         ///< @brief Factor node coordinates are multiplied by.
+        std::string iconDirectory;                  ///< @brief Directory icon paths are relative to, or empty if they are used as they are.
+        bool dashed = false;                        ///< @brief True if all edges are dashed.
+        unsigned threads = 0;                       ///< @brief Number of parsing threads, or 0 to use all hardware threads.
+    };
+
+public:
+    static const int DEFAULT_WIDTH  = 800;
+    static const int DEFAULT_HEIGHT = 600;
+
+    /**
+     * @brief Construct a new graph.
+     */
+    explicit GraphViewer();
+
+    /**
+     * @brief Destroy graph.
+     */
+    ~GraphViewer();
+
+    /**
+     * @brief Create the visualization window.
+     *
+     * @param width Window width (in pixels)
+     * @param height Window height (in pixels)
+     */
+    void createWindow(unsigned int width = DEFAULT_WIDTH, unsigned int height = DEFAULT_HEIGHT);
+
+    bool isWindowOpen() const;
 
     /**
      * @brief Close visualization window.
@@ -612,9 +1241,206 @@ public:
      */
     void removeEdge(id_t id);
 
+    /**
+     * @brief Add several nodes at once.
+     *
+     * Nodes are added under a single lock, and their shapes are computed in a
+     * single pass after all of them were inserted. If any of the IDs already
+     * exists (or is repeated), no node is added.
+     *
+     * @param descriptors   Descriptions of the nodes to be added
+     *
+     * @throws std::invalid_argument    If a node with one of the IDs already exists
+     */
+    void addNodes(const std::vector<NodeDescriptor> &descriptors);
+
+    /**
+     * @brief Add several edges at once.
+     *
+     * Edges are added under a single lock, and their shapes are computed in a
+     * single pass after all of them were inserted. If any of the IDs already
+     * exists (or is repeated) or any of the endpoints does not exist, no edge
+     * is added.
+     *
+     * @param descriptors   Descriptions of the edges to be added
+     *
+     * @throws std::invalid_argument    If an edge with one of the IDs already exists
+     * @throws std::out_of_range        If one of the endpoints does not exist
+     */
+    void addEdges(const std::vector<EdgeDescriptor> &descriptors);
+
+    /**
+     * @brief Remove several nodes at once, and all edges connected to them.
+     *
+     * @param ids   Unique IDs of nodes to be removed
+     *
+     * @throws std::out_of_range    If one of the nodes does not exist; in
+     *                              that case no node is removed
+     */
+    void removeNodes(const std::vector<id_t> &ids);
+
+    /**
+     * @brief Set positions of several nodes at once.
+     *
+     * Nodes are moved under a single lock, and each edge connected to them
+     * is recomputed only once, even if both its nodes moved. Nodes whose
+     * position did not change are skipped. Edge shapes are recomputed in
+     * parallel if many edges moved.
+     *
+     * @param ids       Unique IDs of nodes to be moved
+     * @param positions New positions of the nodes, in the same order
+     *
+     * @throws std::invalid_argument    If the vectors have different sizes
+     * @throws std::out_of_range        If one of the nodes does not exist; in
+     *                                  that case no node is moved
+     */
+    void setPositions(const std::vector<id_t> &ids, const std::vector<sf::Vector2f> &positions);
+
+    /**
+     * @brief Set positions of several nodes at once, from contiguous arrays.
+     *
+     * Same as setPositions(const std::vector<id_t>&, const std::vector<sf::Vector2f>&),
+     * without copying the arrays into vectors.
+     *
+     * @param ids       Unique IDs of nodes to be moved
+     * @param positions New positions of the nodes, in the same order
+     * @param n         Number of nodes
+     *
+     * @throws std::out_of_range        If one of the nodes does not exist; in
+     *                                  that case no node is moved
+     */
+    void setPositions(const id_t *ids, const sf::Vector2f *positions, size_t n);
+
+    /**
+     * @brief Set positions of nodes with consecutive IDs, from a contiguous
+     *        array.
+     *
+     * Suited to simulations that keep positions in an array indexed by node
+     * ID: positions[i] is the new position of node i, for 0 <= i < n.
+     *
+     * @param positions New positions of nodes 0 to n-1
+     * @param n         Number of nodes
+     *
+     * @throws std::out_of_range        If one of the nodes does not exist; in
+     *                                  that case no node is moved
+     */
+    void setPositions(const sf::Vector2f *positions, size_t n);
+
+    /**
+     * @brief Remove all nodes and edges.
+     */
+    void clear();
+
+    /**
+     * @brief Save graph to a binary graph file.
+     *
+     * Binary graph files are made of fixed-size records stored as arrays of
+     * each field, preceded by a table of all distinct strings (labels and
+     * icon paths) they refer to by index. Colors are stored as 32-bit RGBA
+     * integers. Edge shapes can optionally be stored as well, so they do
+     * not need to be computed again when loading.
+     *
+     * @param path      Path of the file
+     * @param geometry  True to store edge shapes
+     *
+     * @throws std::runtime_error   If the file could not be written
+     */
+    void saveBinary(const std::string &path, bool geometry = false);
+
+    /**
+     * @brief Add all nodes and edges in a binary graph file.
+     *
+     * The file is memory-mapped and its records are added in bulk, as with
+     * addNodes(const std::vector<NodeDescriptor>&) and
+     * addEdges(const std::vector<EdgeDescriptor>&).
+     *
+     * @see GraphViewer::saveBinary(const std::string&, bool)
+     *
+     * @param path  Path of the file
+     *
+     * @throws std::runtime_error       If the file could not be read or is
+     *                                  not a valid binary graph file
+     * @throws std::invalid_argument    If a node or edge with one of the IDs
+     *                                  already exists
+     */
+    void loadBinary(const std::string &path);
+
+    /**
+     * @brief Add all nodes and edges in a pair of text graph files, with
+     *        default options.
+     *
+     * @see GraphViewer::loadText(const std::string&, const std::string&, const TextGraphOptions&)
+     */
+    void loadText(const std::string &nodesPath, const std::string &edgesPath);
+
+    /**
+     * @brief Add all nodes and edges in a pair of text graph files.
+     *
+     * The first line of each file is the number of elements, and each of
+     * the following lines describes one element; the n-th line describes
+     * the element with ID n-1. Nodes are described as
+     *
+     *     (x, y, color , label , size, icon )
+     *
+     * and edges as
+     *
+     *     (u, v, type, color ,thickness, label , flow , weight )
+     *
+     * where type is 1 for directed edges and 0 for undirected edges, colors
+     * are names (e.g., blue, dark_gray), labels and icon paths are single
+     * words or - if absent, and flows and weights are numbers or % if
+     * absent.
+     *
+     * Files are memory-mapped, split into chunks and parsed in parallel,
+     * and elements are added in bulk, as with
+     * addNodes(const std::vector<NodeDescriptor>&) and
+     * addEdges(const std::vector<EdgeDescriptor>&).
+     *
+     * @param nodesPath Path of nodes file
+     * @param edgesPath Path of edges file
+     * @param options   Loading options
+     *
+     * @throws std::runtime_error       If a file could not be read or has
+     *                                  an invalid line
+     * @throws std::invalid_argument    If a node or edge with one of the IDs
+     *                                  already exists
+     */
+    void loadText(const std::string &nodesPath, const std::string &edgesPath, const TextGraphOptions &options);
+
 private:
+    /**
+     * @brief Add nodes and then edges in bulk, as loaded from a file.
+     *
+     * If the edges cannot be added, the nodes are removed again.
+     *
+     * @param nodeDescriptors   Descriptions of the nodes to be added
+     * @param edgeDescriptors   Descriptions of the edges to be added
+     *
+     * @throws std::runtime_error       If an edge has an endpoint that does not exist
+     * @throws std::invalid_argument    If a node or edge with one of the IDs already exists
+     */
+    void addGraph(const std::vector<NodeDescriptor> &nodeDescriptors, const std::vector<EdgeDescriptor> &edgeDescriptors);
+
     void removeEdge_noLock(id_t id);
 
+    /**
+     * @brief Remove node from all drawing structures, before it is deleted.
+     *
+     * Assumes graphMutex is already locked.
+     *
+     * @param node  Node to be released
+     */
+    void releaseNode(Node *node);
+
+    /**
+     * @brief Remove edge from all drawing structures, before it is deleted.
+     *
+     * Assumes graphMutex is already locked.
+     *
+     * @param edge  Edge to be released
+     */
+    void releaseEdge(Edge *edge);
+
 public:
     /**
      * @brief Set background color.
@@ -633,7 +1459,11 @@ public:
     /**
      * @brief Set background image.
      *
+     * Background images are loaded through TextureCache.
+     *
      * @param path Filepath of new background
+     *
+     * @throws std::runtime_error   If the file could not be loaded
      */
     void setBackground(const std::string &path, const sf::Vector2f &position = sf::Vector2f(0, 0), const sf::Vector2f &scale = sf::Vector2f(1.0, 1.0), double alpha = 1.0);
 
@@ -642,6 +1472,47 @@ public:
      */
     void clearBackground();
 
+    /**
+     * @brief Render graph to an image, without opening a window.
+     *
+     * The graph is drawn the same way as in the window, into an offscreen
+     * render texture. The render texture is kept and reused by later calls
+     * with the same size, so many images can be rendered without creating
+     * new rendering contexts.
+     *
+     * No window is shown, but an OpenGL context is still created: on Linux
+     * this requires an X display (e.g., a virtual one such as Xvfb on
+     * servers without a screen).
+     *
+     * @param width     Image width, in pixels
+     * @param height    Image height, in pixels
+     * @param center    Coordinates of the center of the image
+     * @param scale     Scale, as in GraphViewer::setScale(float)
+     * @return sf::Image    Rendered image
+     *
+     * @throws std::runtime_error   If the render texture could not be created
+     */
+    sf::Image renderToImage(unsigned int width, unsigned int height, const sf::Vector2f &center, float scale = 1.0);
+
+    /**
+     * @brief Render graph to an image file, without opening a window.
+     *
+     * Has the same requirements as GraphViewer::renderToImage(); on Linux,
+     * an X display is required.
+     *
+     * @see GraphViewer::renderToImage(unsigned int, unsigned int, const sf::Vector2f&, float)
+     *
+     * @param path      Path of image file; format is deduced from the
+     *                  extension (e.g., .png)
+     * @param width     Image width, in pixels
+     * @param height    Image height, in pixels
+     * @param center    Coordinates of the center of the image
+     * @param scale     Scale, as in GraphViewer::setScale(float)
+     *
+     * @throws std::runtime_error   If the image could not be rendered or saved
+     */
+    void renderToFile(const std::string &path, unsigned int width, unsigned int height, const sf::Vector2f &center, float scale = 1.0);
+
     /**
      * @brief Join the window main thread.
      * 
@@ -650,6 +1521,20 @@ public:
      */
     void join();
 
+    /**
+     * @brief Set render scheduler to service the window, instead of a
+     *        dedicated thread.
+     *
+     * Must be called before GraphViewer::createWindow(). The scheduler must
+     * outlive the graph. Has no effect on platforms where the window must be
+     * handled by the main thread.
+     *
+     * @param scheduler Render scheduler, or nullptr to use a dedicated thread
+     *
+     * @throws std::runtime_error   If the window was already created
+     */
+    void setRenderScheduler(RenderScheduler *scheduler);
+
     /**
      * @brief Enable node drawing.
      * 
@@ -687,15 +1572,207 @@ public:
      * object separately; performance improves by about 20 times in large
      * graphs with many edges.
      * 
-     * Please take close attention to the fact that, if edge zipping is enabled,
-     * if you change an edge (or the position of a node that has edges connected
-     * to it) you must afterwards call GraphViewer::setZipEdges(true) again, so
-     * the zipped edges object is properly updated.
+     * Each edge owns a slot in the zipped vertex array, which is patched in
+     * place when the edge (or one of its nodes) changes, so adding, removing
+     * or changing an edge only costs as much as that edge's vertices.
      * 
      * @param b True to zip edges, false if not.
      */
     void setZipEdges(bool b = false);
 
+    /**
+     * @brief Draw dashed edges with a repeating dash pattern texture.
+     *
+     * By default, each dash of a dashed edge is a separate quad, so long
+     * dashed edges have many vertices. With textured dashes, a dashed edge
+     * is a single quad (plus its arrow head) whose texture coordinates
+     * repeat a small dash pattern texture along its length, so its vertex
+     * count does not depend on its length.
+     *
+     * @param b True to draw dashed edges with textured dashes
+     */
+    void setTexturedDashes(bool b);
+
+    /**
+     * @brief Set fraction of each dash period covered by the dash, in dashed
+     *        edges.
+     *
+     * A dash period is DashedLineShape::periodFactor times the edge
+     * thickness. Default is 0.5.
+     *
+     * @param fill  Fraction, in ]0, 1]
+     *
+     * @throws std::invalid_argument    If fill is not in ]0, 1]
+     */
+    void setDashFill(float fill);
+
+    /**
+     * @brief Allow nodes to be zipped.
+     *
+     * Similarly to GraphViewer::setZipEdges(bool), all circle nodes are packed
+     * into a single vertex array and drawn with a single draw call, and icon
+     * nodes are grouped by texture so there is one draw call per distinct
+     * icon. Each node owns a slot that is patched in place when it changes.
+     *
+     * Zipped nodes are always drawn at once, and are not culled.
+     *
+     * @param b True to zip nodes, false if not.
+     */
+    void setZipNodes(bool b = false);
+
+    /**
+     * @brief Allow labels to be zipped.
+     *
+     * All node labels, and all edge labels, are laid out into one vertex
+     * array per font and character size, and drawn with a single draw call
+     * each, instead of one draw call per label. The vertex arrays are only
+     * rebuilt when a label changes or moves.
+     *
+     * Zipped labels are always drawn at once, and are not culled.
+     *
+     * @param b True to zip labels, false if not.
+     */
+    void setZipLabels(bool b = false);
+
+    /**
+     * @brief Enable zoom-dependent level of detail.
+     *
+     * When zoomed out, elements become so small on screen that most of their
+     * geometry is sub-pixel. With level of detail enabled, the on-screen size
+     * of elements is checked against the given thresholds every frame, and
+     * labels are hidden, nodes are drawn as points and edges are drawn as
+     * 1-pixel lines (dropping those shorter than a pixel) accordingly.
+     *
+     * @see GraphViewer::setLevelOfDetail(const LevelOfDetail&)
+     *
+     * @param b     True to enable level of detail, false to always draw full detail
+     */
+    void setLevelOfDetail(bool b = false);
+
+    /**
+     * @brief Set level of detail thresholds.
+     *
+     * @param lod   Thresholds of each tier
+     */
+    void setLevelOfDetail(const LevelOfDetail &lod);
+
+    /**
+     * @brief Draw frames from a snapshot, to reduce lock contention.
+     *
+     * By default, graphMutex is held while the whole frame is drawn, so
+     * threads that change the graph are stalled during that time. With
+     * snapshot rendering, at the beginning of each frame the geometry of
+     * edges and circle nodes is copied (under the lock) into a snapshot,
+     * which is then drawn without holding the lock. Only the background,
+     * icons and labels, which use textures that other threads may change,
+     * are drawn while holding the lock.
+     *
+     * Circle nodes are drawn as with GraphViewer::setZipNodes(bool). With
+     * viewport culling on, only the visible edges are copied, even if edges
+     * are zipped.
+     *
+     * @param b True to draw from snapshots, false to draw while holding the lock
+     */
+    void setSnapshotRendering(bool b = false);
+
+    /**
+     * @brief Defer node and edge geometry updates until the next frame.
+     *
+     * By default, every setter of a node or edge immediately recomputes its
+     * shape and text (and, for nodes, those of all edges connected to it).
+     * With deferred updates, setters only mark the element as dirty, and all
+     * dirty elements are recomputed once just before the next frame is drawn;
+     * each edge is recomputed at most once per frame, even if both its nodes
+     * changed.
+     *
+     * While an element is dirty, its getShape() and getText() may be stale.
+     * Disabling deferred updates immediately recomputes all dirty elements.
+     *
+     * @param b True to defer updates, false to update immediately
+     */
+    void setDeferredUpdates(bool b = false);
+
+    /**
+     * @brief Only draw nodes and edges that are inside the view.
+     *
+     * Nodes and edges are kept in a spatial index (a uniform grid over their
+     * bounding boxes), which is updated whenever they change, so each frame
+     * only draws what intersects the visible area. This makes frame time
+     * depend on what is on screen rather than on the total graph size,
+     * which is especially useful when zoomed in on large graphs.
+     *
+     * Zipped edges are always drawn at once, and are not culled, except
+     * with snapshot rendering, where only the visible edges are copied into
+     * the snapshot.
+     *
+     * @param b         True to cull nodes/edges outside the view, false to draw everything
+     * @param cellSize  Size of the spatial index cells, in pixels
+     */
+    void setViewportCulling(bool b = false, float cellSize = 256.0f);
+
+    /**
+     * @brief Only draw frames when something changed.
+     *
+     * By default, the window thread draws frames continuously, even if
+     * nothing changed, which keeps a processor core busy for each window.
+     * With render on demand, a frame is only drawn after the graph or view
+     * changed, or a window event (e.g., resize, mouse) was received;
+     * otherwise the window thread sleeps.
+     *
+     * Changes made through the GraphViewer, Node and Edge interfaces, and
+     * GraphViewer::unlock(), request a new frame.
+     *
+     * @param b True to draw frames only when something changed, false to
+     *          draw continuously
+     */
+    void setRenderOnDemand(bool b = false);
+
+    /**
+     * @brief Limit number of frames drawn per second.
+     *
+     * @param limit Maximum frames per second, or 0 for no limit
+     */
+    void setFramerateLimit(unsigned limit = 0);
+
+    /**
+     * @brief Enable vertical synchronization.
+     *
+     * @param b True to synchronize frames with the monitor refresh rate,
+     *          false otherwise
+     */
+    void setVerticalSync(bool b = false);
+
+    /**
+     * @brief Get statistics of the last frame drawn in the window.
+     *
+     * The same statistics are shown in the debug overlay (toggled with the
+     * D key).
+     *
+     * @return FrameStats   Statistics; all zero if no frame was drawn yet
+     */
+    FrameStats getFrameStats() const;
+
+    /**
+     * @brief Get distribution of frame times of the window over the last
+     *        second.
+     *
+     * Frame times go from the start of a frame (including handling window
+     * events) until it is displayed; with render on demand, time idle
+     * between frames is not included. The same statistics are shown in the
+     * debug overlay.
+     *
+     * @return FPSMonitor::Statistics   Frame time statistics
+     */
+    FPSMonitor::Statistics getFrameTimes() const;
+
+    /**
+     * @brief Get number of frames per second drawn in the window over the
+     *        last second.
+     *
+     * @return float    Frames per second
+     */
+    float getFPS() const;
+
     /**
      * @brief Lock access to object.
      * 
@@ -719,11 +1796,17 @@ private:
     bool debug_mode = false;                    ///< @brief True if debug mode is enabled, false otherwise.
     FPSMonitor fps_monitor = FPSMonitor(1000);  ///< @brief FPS monitor.
     sf::Text debug_text;                        ///< @brief Debug text to be displayed.
+    FrameStats frameStats;                      ///< @brief Statistics of the frame being drawn in the window.
+    FrameStats lastFrameStats;                  ///< @brief Statistics of the last frame drawn in the window.
+    mutable std::mutex frameStatsMutex;         ///< @brief Mutex protecting lastFrameStats and fps_monitor.
 
     static const sf::Font FONT;                 ///< @brief Font.
     static const int FONT_SIZE = 16;            ///< @brief Font size.
 
     float scale = 1.0;                          ///< @brief Scale (changed with scroll).
+    bool isLeftClickPressed = false;            ///< @brief True while dragging the view.
+    sf::Vector2f centerInitial;                 ///< @brief Center of the window when dragging started.
+    sf::Vector2f posMouseInitial;               ///< @brief Mouse position when dragging started.
     /**
      * @brief Scale factor.
      * 
@@ -736,58 +1819,179 @@ private:
     static constexpr float SCALE_DELTA = 1.5;
     sf::Vector2f center;                        ///< @brief Coordinates of center of the window.
 
-    sf::Texture background_texture;             ///< @brief Background texture (must be kept alive).
+    TextureCache::Handle background_texture;    ///< @brief Background texture (must be kept alive).
     sf::Sprite background_sprite;               ///< @brief Background sprite.
     sf::Color background_color = sf::Color::White; ///< @brief Background color.
     sf::RenderWindow *window = nullptr;         ///< @brief Window.
     sf::View *view       = nullptr;             ///< @brief Default view, to draw the graph.
     sf::View *debug_view = nullptr;             ///< @brief Debug view, to draw debug information.
+    sf::RenderTexture *offscreen = nullptr;     ///< @brief Render texture for headless rendering; reused across renders.
     std::thread *main_thread = nullptr;         ///< @brief Main thread.
-    bool windowOpen = false;
+    RenderScheduler *scheduler = nullptr;       ///< @brief Render scheduler servicing the window, or nullptr.
+    std::atomic<bool> windowOpen{false};        ///< @brief True while the window is open.
     std::condition_variable isWindowOpenCV;     ///< @brief Condition variable to check if window is open.
     std::mutex isWindowOpenCVMutex;             ///< @brief Mutex of isWindowOpenCV condition variable.
 
+    static const int IDLE_POLL_INTERVAL = 10;   ///< @brief Interval to poll window events while idle, in milliseconds.
+    std::atomic<bool> renderOnDemand{false};    ///< @brief Only draw frames when something changed.
+    std::atomic<bool> redrawRequested{true};    ///< @brief True if a new frame should be drawn.
+    std::condition_variable redrawCV;           ///< @brief Condition variable to wake up window thread when a frame is requested.
+    std::mutex redrawMutex;                     ///< @brief Mutex of redrawCV condition variable.
+    std::atomic<unsigned> framerateLimit{0};    ///< @brief Maximum frames per second, or 0 for no limit.
+    std::atomic<bool> verticalSync{false};      ///< @brief Vertical synchronization enabled.
+    std::atomic<bool> windowSettingsChanged{true}; ///< @brief True if framerate limit/vertical sync must be applied to the window.
+    /**
+     * @brief Request a new frame to be drawn.
+     */
+    void requestRedraw();
+
     bool enabledNodes     = true;               ///< @brief Node drawing enabled.
     bool enabledNodesText = true;               ///< @brief Node text drawing enabled.
     bool enabledEdges     = true;               ///< @brief Edge drawing enabled.
     bool enabledEdgesText = true;               ///< @brief Edge text drawing enabled.
 
-    /**
-     * @brief Class to save zipped edges.
-     * 
-     * Only works properly with vertex arrays meant to be drawn as sf::Quads.
-     */
-    class ZipEdges {
-    private:
-        std::vector<sf::Vertex> vertices;       ///< @brief Vertices vector, the zipped version of several vertex arrays
-    public:
-        /**
-         * @brief Append vertex array.
-         * 
-         * @param a Vertex array to append.
-         */
-        void append(const sf::VertexArray &a);
-        /**
-         * @brief Get vertex vector.
-         * 
-         * @return const std::vector<sf::Vertex>& Vertex vector to be drawn.
-         */
-        const std::vector<sf::Vertex>& getVertices() const;
-    };
     bool zipEdges = false;                      ///< @brief Zip edges or not.
     ZipEdges zip;                               ///< @brief Zipped edges object.
+    ZipEdges dashZip;                           ///< @brief Zipped edges object of textured dashed edges.
+    /**
+     * @brief Check if any zipped edges object should be rebuilt.
+     *
+     * @return true     If most of one of them is made of released slots
+     */
+    bool isZipFragmented() const;
+
+    bool texturedDashes = false;                ///< @brief Draw dashed edges as quads with the dash pattern texture.
+    float dashFill = 0.5f;                      ///< @brief Fraction of each dash period covered by the dash.
+    std::shared_ptr<sf::Texture> dashTexture;   ///< @brief Dash pattern texture, created when first drawn; replaced, not reloaded, when the fill changes.
+    float dashTextureFill = 0.0f;               ///< @brief Dash fill the dash pattern texture was made with.
+    /**
+     * @brief Get dash pattern texture, (re)creating it if needed.
+     *
+     * @return const sf::Texture&   Dash pattern texture
+     */
+    const sf::Texture& getDashTexture();
     /**
-     * @brief Update zip object.
+     * @brief Recompute all dashed edges.
+     *
+     * Assumes graphMutex is already locked.
+     */
+    void invalidateDashedEdges();
+    /**
+     * @brief Rebuild zip object from scratch, compacting it.
+     *
+     * Assumes graphMutex is already locked.
      */
     void updateZip();
 
+    bool zipNodes = false;                      ///< @brief Zip nodes or not.
+    ZipNodes nodeZip;                           ///< @brief Zipped nodes object.
+
+    bool zipLabels = false;                     ///< @brief Zip labels or not.
+    ZipLabels nodeLabelZip;                     ///< @brief Zipped node labels object.
+    ZipLabels edgeLabelZip;                     ///< @brief Zipped edge labels object.
+    /**
+     * @brief Rebuild zipped labels objects that were invalidated, if their
+     *        labels are shown.
+     *
+     * Assumes graphMutex is already locked.
+     */
+    void updateLabelZip();
+
+    bool levelOfDetail = false;                 ///< @brief Level of detail enabled.
+    LevelOfDetail lod;                          ///< @brief Level of detail thresholds.
+    float pixelsPerUnit = 1.0;                  ///< @brief Screen pixels per graph pixel in window view.
+    MaxSize nodeSizes;                          ///< @brief Sizes of nodes with a shape, including outline.
+    MaxSize edgeThicknesses;                    ///< @brief Thicknesses of edges with a shape.
+    MaxSize labelSizes;                         ///< @brief Character sizes of non-empty node and edge labels.
+    /**
+     * @brief Make 1-pixel lines of visible edges, dropping those shorter than
+     *        the level of detail threshold.
+     *
+     * @param pass      Render pass, with the visible edges
+     * @param vertices  Vector where line vertices are saved
+     */
+    void makeEdgeLines(const RenderPass &pass, std::vector<sf::Vertex> &vertices) const;
+    /**
+     * @brief Make points of visible nodes.
+     *
+     * @param pass      Render pass, with the visible nodes
+     * @param vertices  Vector where point vertices are saved
+     */
+    void makeNodePoints(const RenderPass &pass, std::vector<sf::Vertex> &vertices) const;
+
+    bool snapshotRendering = false;             ///< @brief Draw frames from a snapshot.
+    FrameSnapshot snapshot;                     ///< @brief Snapshot of the current frame; only used by the window thread.
+    /**
+     * @brief Copy geometry of the current frame into the snapshot.
+     *
+     * Only visible edges are copied if culling; otherwise zipped edges are
+     * copied only if they changed since the last snapshot.
+     *
+     * Assumes graphMutex is already locked.
+     *
+     * @param pass          Render pass of the window frame
+     * @param edgesAsLines  True to draw edges as 1-pixel lines
+     * @param nodesAsPoints True to draw nodes as points
+     */
+    void updateSnapshot(const RenderPass &pass, bool edgesAsLines, bool nodesAsPoints);
+
+    bool deferredUpdates = false;               ///< @brief Defer node/edge updates until next frame.
+    std::vector<id_t> dirtyNodes;               ///< @brief IDs of nodes waiting for a deferred update.
+    std::vector<id_t> dirtyEdges;               ///< @brief IDs of edges waiting for a deferred update.
+    std::vector<Edge*> flushEdges;              ///< @brief Edges being updated by flushUpdates(); kept to reuse its memory.
+    /**
+     * @brief Recompute all nodes and edges waiting for a deferred update.
+     *
+     * Edge shapes are recomputed in parallel; everything that touches
+     * structures shared by several edges is then updated serially.
+     *
+     * Assumes graphMutex is already locked.
+     */
+    void flushUpdates();
+    /**
+     * @brief Move nodes, and recompute them if updates are not deferred.
+     *
+     * Assumes graphMutex is already locked.
+     *
+     * @param moved     Nodes to be moved
+     * @param positions New positions of the nodes, in the same order
+     */
+    void setPositions_noLock(const std::vector<Node*> &moved, const sf::Vector2f *positions);
+    /**
+     * @brief Update shapes of several edges, as Edge::updateShape() would.
+     *
+     * Full lines are built in batches (see LineBatch), and all shapes are
+     * built in parallel if there are many edges. Only edge shapes are
+     * updated.
+     *
+     * @param edges     Edges to be updated
+     */
+    void updateEdgeShapes(const std::vector<Edge*> &edges);
+
+    bool viewportCulling = false;               ///< @brief Only draw nodes/edges inside the view.
+    SpatialGrid<Node*> nodeGrid;                ///< @brief Spatial index of nodes.
+    SpatialGrid<Edge*> edgeGrid;                ///< @brief Spatial index of edges.
+    unsigned long removals = 0;                 ///< @brief Number of nodes/edges removed so far.
+    RenderPass windowPass;                      ///< @brief Render pass of window frames; kept to reuse its memory.
+    /**
+     * @brief Find nodes and edges to be drawn in a render pass.
+     *
+     * Assumes graphMutex is already locked.
+     *
+     * @param view  View the pass is drawn with
+     * @param pass  Render pass where visible nodes/edges are saved
+     */
+    void updateVisible(const sf::View &view, RenderPass &pass);
+
     /**
      * @brief Mutex protecting structures that are being drawn and that can
      * be updated by another thread at the same time.
      */
     mutable std::mutex graphMutex;
-    std::unordered_map<id_t, Node*> nodes;   ///< @brief Nodes map.
-    std::unordered_map<id_t, Edge*> edges;   ///< @brief Edges map.
+    ObjectPool<Node> nodePool;               ///< @brief Storage of nodes.
+    ObjectPool<Edge> edgePool;               ///< @brief Storage of edges.
+    IdIndex<Node> nodes;                     ///< @brief Nodes by ID.
+    IdIndex<Edge> edges;                     ///< @brief Edges by ID.
 
     /**
      * @brief Main entry point for event processing.
@@ -796,10 +2000,82 @@ private:
      * events and drawing. 
      */
     void run();
+    /**
+     * @brief Create the window.
+     */
+    void openWindow();
+    /**
+     * @brief Apply window settings, and process pending window events.
+     */
+    void processEvents();
+    /**
+     * @brief Check if a frame should be drawn, consuming a redraw request.
+     *
+     * @return true     If a frame should be drawn
+     */
+    bool isFrameRequested();
+    /**
+     * @brief Draw a frame and display it, publishing its statistics.
+     *
+     * @param frameStart    Time the frame started, before processing events
+     */
+    void renderFrame(const std::chrono::steady_clock::time_point &frameStart);
+    /**
+     * @brief Mark the window as closed, waking up threads waiting for it.
+     */
+    void finishWindow();
     /**
      * @brief Draw graph and debug information.
      */
     void draw();
+    /**
+     * @brief Draw graph to a render target.
+     *
+     * Assumes graphMutex is already locked.
+     *
+     * @param target        Render target to draw to
+     * @param view          View to draw with
+     * @param pixelsPerUnit Screen pixels per graph pixel in that view
+     * @param lock          Lock of graphMutex, to draw from a snapshot while
+     *                      unlocked; nullptr to draw everything while locked
+     * @param pass          Render pass, owned by this render only
+     * @param stats         Statistics of the frame, to be updated
+     */
+    void drawScene(sf::RenderTarget &target, const sf::View &view, float pixelsPerUnit, std::unique_lock<std::mutex> *lock, RenderPass &pass, FrameStats &stats);
+    /**
+     * @brief Draw edges; called by GraphViewer::drawScene().
+     *
+     * @param target    Render target to draw to
+     * @param pass      Render pass being drawn
+     * @param asLines   True to draw edges as 1-pixel lines
+     * @param stats     Statistics of the frame being drawn
+     */
+    void drawEdges(sf::RenderTarget &target, RenderPass &pass, bool asLines, FrameStats &stats);
+    /**
+     * @brief Draw nodes; called by GraphViewer::drawScene().
+     *
+     * @param target    Render target to draw to
+     * @param pass      Render pass being drawn
+     * @param asPoints  True to draw nodes as points
+     * @param stats     Statistics of the frame being drawn
+     */
+    void drawNodes(sf::RenderTarget &target, RenderPass &pass, bool asPoints, FrameStats &stats);
+    /**
+     * @brief Draw icon nodes only; called by GraphViewer::drawScene().
+     *
+     * @param target    Render target to draw to
+     * @param pass      Render pass being drawn
+     * @param stats     Statistics of the frame being drawn
+     */
+    void drawIcons(sf::RenderTarget &target, const RenderPass &pass, FrameStats &stats);
+    /**
+     * @brief Draw node and edge labels; called by GraphViewer::drawScene().
+     *
+     * @param target    Render target to draw to
+     * @param pass      Render pass being drawn
+     * @param stats     Statistics of the frame being drawn
+     */
+    void drawLabels(sf::RenderTarget &target, const RenderPass &pass, FrameStats &stats);
     /**
      * @brief Draw debug information; called by GraphViewer::draw().
      */
@@ -0,0 +1,308 @@
+#ifndef ID_INDEX_H_INCLUDED
+#define ID_INDEX_H_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @brief Index of objects by integer ID.
+ *
+ * IDs are usually dense (e.g., 0 to N-1, or a contiguous range starting
+ * elsewhere), in which case objects are kept in a vector indexed by ID
+ * minus the lowest ID. As soon as an ID would make that vector too sparse,
+ * the index switches to a flat open-addressing hash table with linear
+ * probing; whenever that table grows, it switches back if the range of IDs
+ * became dense (e.g., IDs of a dense range were added out of order).
+ * Both layouts store pointers in contiguous memory, unlike node-based maps.
+ *
+ * @tparam T Type of indexed objects; the index stores non-null pointers to T
+ */
+template<class T>
+class IdIndex {
+public:
+    typedef int64_t id_t;
+
+private:
+    /**
+     * @brief Dense vector may have up to this many empty slots per object,
+     *        plus MIN_DENSE_SLACK.
+     */
+    static const size_t DENSE_FACTOR = 2;
+    static const size_t MIN_DENSE_SLACK = 1024; ///< @brief Empty slots always allowed in dense vector.
+    static const size_t MIN_CAPACITY = 16;      ///< @brief Minimum capacity of hash table.
+
+    /**
+     * @brief Slot of hash table; empty if value is nullptr.
+     */
+    struct Slot {
+        id_t id;
+        T *value;
+    };
+
+    bool dense = true;              ///< @brief True if objects are in the dense vector.
+    id_t base = 0;                  ///< @brief ID of the first slot of the dense vector.
+    std::vector<T*> values;         ///< @brief Dense vector; nullptr where there is no object.
+    std::vector<Slot> slots;        ///< @brief Hash table, with power-of-two capacity.
+    size_t numObjects = 0;          ///< @brief Number of objects.
+    size_t sparseSize = 0;          ///< @brief Number of objects when switched to the hash table.
+    id_t minId = 0;                 ///< @brief Lowest ID added to the hash table since it was created.
+    id_t maxId = 0;                 ///< @brief Highest ID added to the hash table since it was created.
+
+    static size_t hash(id_t id){
+        // Finalizer of splitmix64, so consecutive/strided IDs are spread out
+        uint64_t x = uint64_t(id);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return size_t(x ^ (x >> 31));
+    }
+
+    /**
+     * @brief Get offset of an ID in the dense vector.
+     *
+     * @param id        ID, not less than base
+     * @return uint64_t Offset
+     */
+    uint64_t offset(id_t id) const {
+        return uint64_t(id) - uint64_t(base);
+    }
+
+    size_t maxDenseSize(size_t n) const {
+        return DENSE_FACTOR*n + MIN_DENSE_SLACK;
+    }
+
+    /**
+     * @brief Find slot of an ID in the hash table.
+     *
+     * @param id        ID
+     * @return size_t   Slot with that ID, or empty slot where it would be
+     */
+    size_t probe(id_t id) const {
+        const size_t mask = slots.size()-1;
+        size_t i = hash(id) & mask;
+        while(slots[i].value != nullptr && slots[i].id != id)
+            i = (i+1) & mask;
+        return i;
+    }
+
+    void rehash(size_t capacity){
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.assign(capacity, Slot{0, nullptr});
+        for(const Slot &s: old)
+            if(s.value != nullptr) slots[probe(s.id)] = s;
+    }
+
+    /**
+     * @brief Grow hash table to hold a number of objects.
+     *
+     * @param n         Number of objects
+     * @return true     If the table was rehashed
+     */
+    bool growHash(size_t n){
+        size_t capacity = (slots.empty() ? MIN_CAPACITY : slots.size());
+        // Keep load factor at most 1/2, so probe sequences stay short
+        while(capacity < 2*n) capacity *= 2;
+        if(capacity == slots.size()) return false;
+        rehash(capacity);
+        return true;
+    }
+
+    /**
+     * @brief Move objects from the dense vector to the hash table.
+     */
+    void makeSparse(){
+        dense = false;
+        sparseSize = numObjects;
+        slots.clear();
+        growHash(numObjects+1);
+        minId = base;
+        maxId = base + id_t(values.size()) - 1;
+        for(size_t i = 0; i < values.size(); ++i)
+            if(values[i] != nullptr) slots[probe(base + id_t(i))] = Slot{base + id_t(i), values[i]};
+        values = std::vector<T*>();
+    }
+
+    /**
+     * @brief Move objects from the hash table to the dense vector.
+     */
+    void makeDense(){
+        dense = true;
+        base = minId;
+        values.assign(size_t(uint64_t(maxId) - uint64_t(minId)) + 1, nullptr);
+        for(const Slot &s: slots)
+            if(s.value != nullptr) values[size_t(offset(s.id))] = s.value;
+        slots = std::vector<Slot>();
+    }
+
+    /**
+     * @brief Add object to the dense vector, if it stays dense enough.
+     *
+     * @param id        ID, with no object yet
+     * @param value     Object
+     * @return true     If the object was added
+     */
+    bool insertDense(id_t id, T *value){
+        const size_t limit = maxDenseSize(numObjects+1);
+        if(id >= base){
+            if(offset(id) >= limit) return false;
+            if(offset(id) >= values.size()) values.resize(size_t(offset(id)) + 1, nullptr);
+        } else {
+            uint64_t need = uint64_t(base) - uint64_t(id);
+            if(need + values.size() > limit) return false;
+            // Grow downwards geometrically, so adding IDs in descending
+            // order takes amortized constant time
+            uint64_t grow = std::max(need, std::min(uint64_t(values.size()), uint64_t(limit - values.size())));
+            if(grow > uint64_t(base) - uint64_t(std::numeric_limits<id_t>::min())) grow = need;
+            values.insert(values.begin(), size_t(grow), nullptr);
+            base = id_t(uint64_t(base) - grow);
+        }
+        values[size_t(offset(id))] = value;
+        ++numObjects;
+        return true;
+    }
+
+public:
+    /**
+     * @brief Get object with an ID.
+     *
+     * @param id    ID
+     * @return T*   Object, or nullptr if there is none with that ID
+     */
+    T* get(id_t id) const {
+        if(dense){
+            if(id < base || offset(id) >= values.size()) return nullptr;
+            return values[size_t(offset(id))];
+        }
+        if(slots.empty()) return nullptr;
+        return slots[probe(id)].value;
+    }
+
+    /**
+     * @brief Get object with an ID.
+     *
+     * @param id    ID
+     * @return T*   Object
+     *
+     * @throws std::out_of_range    If there is no object with that ID
+     */
+    T* at(id_t id) const {
+        T *ret = get(id);
+        if(ret == nullptr) throw std::out_of_range("No object with that ID");
+        return ret;
+    }
+
+    /**
+     * @brief Count objects with an ID.
+     *
+     * @param id        ID
+     * @return size_t   1 if there is an object with that ID, 0 otherwise
+     */
+    size_t count(id_t id) const { return (get(id) != nullptr ? 1 : 0); }
+
+    /**
+     * @brief Add object with an ID, if there is none yet.
+     *
+     * @param id        ID
+     * @param value     Object; must not be nullptr
+     * @return true     If the object was added
+     * @return false    If there already was an object with that ID
+     */
+    bool insert(id_t id, T *value){
+        if(get(id) != nullptr) return false;
+        if(dense){
+            if(values.empty()) base = id;
+            if(insertDense(id, value)) return true;
+            makeSparse();
+        }
+        // Only switch back once the number of objects doubled since
+        // switching to the hash table, so switches take amortized constant
+        // time
+        if(growHash(numObjects+1) && numObjects >= 2*sparseSize &&
+           uint64_t(std::max(maxId, id)) - uint64_t(std::min(minId, id)) < maxDenseSize(numObjects+1)){
+            makeDense();
+            return insertDense(id, value);
+        }
+        slots[probe(id)] = Slot{id, value};
+        minId = std::min(minId, id);
+        maxId = std::max(maxId, id);
+        ++numObjects;
+        return true;
+    }
+
+    /**
+     * @brief Remove object with an ID.
+     *
+     * @param id        ID
+     * @return true     If an object was removed
+     * @return false    If there was no object with that ID
+     */
+    bool erase(id_t id){
+        if(dense){
+            if(id < base || offset(id) >= values.size()) return false;
+            T *&slot = values[size_t(offset(id))];
+            if(slot == nullptr) return false;
+            slot = nullptr;
+            --numObjects;
+            while(!values.empty() && values.back() == nullptr) values.pop_back();
+            return true;
+        }
+        if(slots.empty()) return false;
+        const size_t mask = slots.size()-1;
+        size_t i = probe(id);
+        if(slots[i].value == nullptr) return false;
+        // Backward-shift deletion: move later entries of the probe sequence
+        // into the hole, so no tombstones are needed
+        size_t j = i;
+        while(true){
+            j = (j+1) & mask;
+            if(slots[j].value == nullptr) break;
+            size_t home = hash(slots[j].id) & mask;
+            // Move slot j to i unless its home lies cyclically in (i, j]
+            if(((j - home) & mask) >= ((j - i) & mask)){
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        slots[i] = Slot{0, nullptr};
+        --numObjects;
+        return true;
+    }
+
+    /**
+     * @brief Prepare the index to hold a number of objects.
+     *
+     * @param n     Number of objects
+     */
+    void reserve(size_t n){
+        if(dense) values.reserve(n);
+        else growHash(n);
+    }
+
+    /**
+     * @brief Remove all objects, and go back to the dense layout.
+     */
+    void clear(){
+        dense = true;
+        base = 0;
+        values = std::vector<T*>();
+        slots = std::vector<Slot>();
+        numObjects = 0;
+    }
+
+    size_t size() const { return numObjects; }
+    bool empty() const { return numObjects == 0; }
+
+    /**
+     * @brief Check if objects are kept in the dense layout.
+     *
+     * @return true     If dense
+     * @return false    If in the hash table
+     */
+    bool isDense() const { return dense; }
+};
+
+#endif // ID_INDEX_H_INCLUDED
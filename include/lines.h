@@ -99,16 +99,35 @@ public:
  */
 class GraphViewer::DashedLineShape: public GraphViewer::LineShape {
 private:
-    float dashFill = 0.5;
+    float dashFill;
 public:
+    static const float periodFactor;        ///< @brief Length of a dash and the following gap, in line widths.
+    static const unsigned patternSize = 64; ///< @brief Width of the dash pattern texture, in pixels.
+
     /**
      * @brief Construct a new DashedLineShape.
      * 
-     * @param u     Origin position
-     * @param v     Destination position
-     * @param w     Line width
+     * @param u         Origin position
+     * @param v         Destination position
+     * @param w         Line width
+     * @param dashFill  Fraction of each period covered by the dash
      */
-    explicit DashedLineShape(const sf::Vector2f& u, const sf::Vector2f& v, float w);
+    explicit DashedLineShape(const sf::Vector2f& u, const sf::Vector2f& v, float w, float dashFill = 0.5);
+
+    /**
+     * @brief Set texture coordinates of a full line, so it is drawn dashed
+     *        with the dash pattern texture.
+     *
+     * The pattern texture is patternSize pixels wide, repeated, with the
+     * dash at its start. The line is the last quad of the vertices; any
+     * vertices before it (e.g., an arrow head) are mapped to the start of
+     * the dash, so they are drawn solid.
+     *
+     * @param vertices  Vertices, as built by LineBatch
+     * @param n         Number of vertices
+     * @param w         Line width
+     */
+    static void setTexCoords(sf::Vertex *vertices, size_t n, float w);
 
     void setFrom (const sf::Vector2f& u) override;
     void setTo   (const sf::Vector2f& v) override;
@@ -121,6 +140,7 @@ public:
 };
 
 class GraphViewer::ArrowHead: public GraphViewer::LineShape {
+    friend class LineBatch;
 private:
     static const float widthFactor;
     static const float lengthFactor;
@@ -140,4 +160,89 @@ public:
     sf::Vector2f getLineConnection() const;
 };
 
+/**
+ * @brief Batch of full lines, to build the geometry of many edges at once.
+ *
+ * Builds the same vertices as FullLineShape (preceded by an ArrowHead, if
+ * the batch has arrows), without intermediate shapes. Lines are kept as
+ * separate arrays of each coordinate, so several lines are computed at once
+ * with SIMD instructions: AVX if the library is compiled with it
+ * (GRAPHVIEWER_AVX in CMake), SSE2 on other x86 targets, and scalar code
+ * elsewhere. Vertices are written directly to the vertex array of each
+ * line, which must already have room for getVertexCount(bool) vertices.
+ */
+class GraphViewer::LineBatch {
+private:
+    bool arrows;                    ///< @brief True if lines end with an arrow head.
+    std::vector<float> ux, uy;      ///< @brief Origin positions.
+    std::vector<float> vx, vy;      ///< @brief Destination positions.
+    std::vector<float> ut, vt;      ///< @brief Lengths to trim from the origin/destination.
+    std::vector<float> w;           ///< @brief Line widths.
+    std::vector<sf::Color> colors;  ///< @brief Line colors.
+    std::vector<sf::Vertex*> out;   ///< @brief Where to write the vertices of each line.
+public:
+    /**
+     * @brief Construct a new empty LineBatch.
+     *
+     * @param arrows    True if lines end with an arrow head
+     */
+    explicit LineBatch(bool arrows);
+
+    /**
+     * @brief Get number of vertices of each line.
+     *
+     * @param arrows    True if lines end with an arrow head
+     * @return size_t   Number of vertices
+     */
+    static size_t getVertexCount(bool arrows);
+
+    /**
+     * @brief Build vertices of a single line, without SIMD instructions.
+     *
+     * Arguments are the same as in add(), plus whether the line ends with an
+     * arrow head.
+     */
+    static void buildLine(const sf::Vector2f &u, const sf::Vector2f &v, float uTrim, float vTrim, float width, const sf::Color &color, bool arrows, sf::Vertex *vertices);
+
+    /**
+     * @brief Add line to the batch.
+     *
+     * @param u         Origin position
+     * @param v         Destination position
+     * @param uTrim     Length to trim from the origin
+     * @param vTrim     Length to trim from the destination
+     * @param width     Line width
+     * @param color     Line color
+     * @param vertices  Where to write the vertices of the line
+     */
+    void add(const sf::Vector2f &u, const sf::Vector2f &v, float uTrim, float vTrim, float width, const sf::Color &color, sf::Vertex *vertices);
+
+    /**
+     * @brief Get number of lines.
+     *
+     * @return size_t   Number of lines
+     */
+    size_t size() const;
+
+    /**
+     * @brief Remove all lines.
+     */
+    void clear();
+
+    /**
+     * @brief Build vertices of a range of lines.
+     *
+     * Different ranges can be built in parallel.
+     *
+     * @param begin     First line
+     * @param end       Past the last line
+     */
+    void build(size_t begin, size_t end) const;
+
+    /**
+     * @brief Build vertices of all lines.
+     */
+    void build() const;
+};
+
 #endif // GV_LINES_H_INCLUDED
@@ -0,0 +1,56 @@
+#ifndef MAPPED_FILE_H_INCLUDED
+#define MAPPED_FILE_H_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * The file contents are paged in by the operating system as they are
+ * accessed, so reading a file this way does not copy it to a user buffer.
+ */
+class MappedFile {
+private:
+    const char *data = nullptr;     ///< @brief Start of the mapping.
+    size_t size = 0;                ///< @brief Size of the file, in bytes.
+#ifdef _WIN32
+    void *file = nullptr;           ///< @brief File handle.
+    void *mapping = nullptr;        ///< @brief File mapping handle.
+#endif
+
+public:
+    /**
+     * @brief Map a file.
+     *
+     * @param path  Path of the file
+     *
+     * @throws std::runtime_error   If the file cannot be opened or mapped
+     */
+    explicit MappedFile(const std::string &path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Unmap the file.
+     */
+    ~MappedFile();
+
+    /**
+     * @brief Get file contents.
+     *
+     * @return const char*  Start of the file contents, or nullptr if the
+     *                      file is empty
+     */
+    const char* getData() const;
+
+    /**
+     * @brief Get file size.
+     *
+     * @return size_t   Size of the file, in bytes
+     */
+    size_t getSize() const;
+};
+
+#endif // MAPPED_FILE_H_INCLUDED
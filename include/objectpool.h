@@ -0,0 +1,170 @@
+#ifndef OBJECT_POOL_H_INCLUDED
+#define OBJECT_POOL_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Pool of objects stored contiguously in fixed-size chunks.
+ *
+ * Objects are constructed in place in slots of large chunks, instead of
+ * being allocated one by one, so objects created together are next to each
+ * other in memory and iterating over the pool walks memory sequentially.
+ * Chunks are never moved or freed until the pool is cleared, so pointers to
+ * objects are stable handles that remain valid until the object is
+ * destroyed. Slots of destroyed objects are reused by the next objects
+ * created.
+ *
+ * @tparam T            Object type
+ * @tparam CHUNK_SIZE   Number of objects in each chunk
+ */
+template<class T, size_t CHUNK_SIZE = 1024>
+class ObjectPool {
+private:
+    /**
+     * @brief Storage of one object, and whether it is in use.
+     *
+     * The object is the first member, so a pointer to the object is also a
+     * pointer to its slot.
+     */
+    struct Slot {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage; ///< @brief Object storage.
+        uint32_t index;                 ///< @brief Index of the slot in the pool.
+        bool used;                      ///< @brief True if the slot holds an object.
+
+        T* get(){ return reinterpret_cast<T*>(&storage); }
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> chunks;    ///< @brief Chunks of slots.
+    size_t highWater = 0;               ///< @brief Number of slots ever used; all later slots are unused.
+    size_t count = 0;                   ///< @brief Number of objects in the pool.
+    std::vector<uint32_t> freeSlots;    ///< @brief Indices of released slots below highWater.
+
+    Slot& slot(size_t i) const {
+        return chunks[i/CHUNK_SIZE][i%CHUNK_SIZE];
+    }
+
+public:
+    /**
+     * @brief Iterator over the objects in the pool, in memory order.
+     */
+    class iterator {
+    private:
+        const ObjectPool *pool;
+        size_t i;
+        void skip(){ while(i < pool->highWater && !pool->slot(i).used) ++i; }
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef T* pointer;
+        typedef T& reference;
+
+        iterator(const ObjectPool *pool, size_t i): pool(pool), i(i) { skip(); }
+        T& operator*() const { return *pool->slot(i).get(); }
+        T* operator->() const { return pool->slot(i).get(); }
+        iterator& operator++(){ ++i; skip(); return *this; }
+        bool operator==(const iterator &it) const { return i == it.i; }
+        bool operator!=(const iterator &it) const { return i != it.i; }
+    };
+
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    ~ObjectPool(){ clear(); }
+
+    /**
+     * @brief Construct an object in the pool.
+     *
+     * @param args      Arguments of the constructor of T
+     * @return T*       Pointer to the object, valid until it is destroyed
+     */
+    template<class... Args>
+    T* create(Args&&... args){
+        size_t i;
+        if(!freeSlots.empty()){
+            i = freeSlots.back();
+        } else {
+            i = highWater;
+            if(i/CHUNK_SIZE >= chunks.size())
+                chunks.emplace_back(new Slot[CHUNK_SIZE]());
+        }
+        Slot &s = slot(i);
+        T *ret = new(&s.storage) T(std::forward<Args>(args)...);
+        s.index = uint32_t(i);
+        s.used = true;
+        if(!freeSlots.empty()) freeSlots.pop_back();
+        else ++highWater;
+        ++count;
+        return ret;
+    }
+
+    /**
+     * @brief Destroy an object of the pool, and release its slot.
+     *
+     * @param object    Pointer to object, as returned by ObjectPool::create
+     */
+    void destroy(T *object){
+        Slot *s = reinterpret_cast<Slot*>(object);
+        object->~T();
+        s->used = false;
+        freeSlots.push_back(s->index);
+        --count;
+    }
+
+    /**
+     * @brief Destroy all objects, and free all memory.
+     */
+    void clear(){
+        for(size_t i = 0; i < highWater; ++i){
+            Slot &s = slot(i);
+            if(s.used){
+                s.get()->~T();
+                s.used = false;
+            }
+        }
+        chunks.clear();
+        freeSlots.clear();
+        highWater = count = 0;
+    }
+
+    /**
+     * @brief Reserve memory for a number of objects.
+     *
+     * @param n     Number of objects
+     */
+    void reserve(size_t n){
+        size_t needed = (n > count ? n - count : 0);
+        needed = (needed > freeSlots.size() ? needed - freeSlots.size() : 0);
+        size_t slots = highWater + needed;
+        while(chunks.size()*CHUNK_SIZE < slots)
+            chunks.emplace_back(new Slot[CHUNK_SIZE]());
+    }
+
+    /**
+     * @brief Get number of objects in the pool.
+     *
+     * @return size_t   Number of objects
+     */
+    size_t size() const { return count; }
+
+    /**
+     * @brief Check if the pool has no objects.
+     *
+     * @return true     If it has no objects
+     * @return false    Otherwise
+     */
+    bool empty() const { return count == 0; }
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end  () const { return iterator(this, highWater); }
+};
+
+#endif // OBJECT_POOL_H_INCLUDED
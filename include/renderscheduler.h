@@ -0,0 +1,143 @@
+#ifndef RENDER_SCHEDULER_H_INCLUDED
+#define RENDER_SCHEDULER_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "graphviewer.h"
+
+/**
+ * @brief Threads that service the windows of many graphs.
+ *
+ * By default, each window gets its own thread, which polls events and draws
+ * frames. With many windows, that is one busy thread and one OpenGL context
+ * switch per window. A scheduler instead services all windows assigned to
+ * it with a few threads (one by default): each thread polls the events of
+ * its windows and draws a frame for each window that is due, in turn, then
+ * sleeps until the next frame of any of its windows is due or a redraw is
+ * requested.
+ *
+ * Each window is paced by its own frame budget: its framerate limit (see
+ * GraphViewer::setFramerateLimit(unsigned)), or the default frame rate of
+ * the scheduler if it has none. The framerate limit and vertical sync of
+ * the window itself are not used, as they would block the thread while
+ * other windows are waiting.
+ *
+ * A window stays on the thread that created it, as some platforms require
+ * events to be polled by that thread; new windows go to the thread with
+ * fewest windows.
+ *
+ * @see GraphViewer::setRenderScheduler(RenderScheduler*)
+ */
+class RenderScheduler {
+private:
+    typedef std::chrono::steady_clock clock;
+
+    /**
+     * @brief Window serviced by a worker.
+     */
+    struct Window {
+        GraphViewer *graph;                 ///< @brief Graph the window belongs to.
+        clock::time_point nextFrame;        ///< @brief Time the next frame may be drawn.
+    };
+
+    /**
+     * @brief Thread servicing a set of windows.
+     */
+    struct Worker {
+        std::thread thread;                 ///< @brief Thread.
+        std::vector<GraphViewer*> added;    ///< @brief Windows to be opened by the thread.
+        std::vector<GraphViewer*> removed;  ///< @brief Windows to be closed by the thread.
+        std::vector<Window> windows;        ///< @brief Windows serviced by the thread; only used by the thread.
+        size_t count = 0;                   ///< @brief Number of windows assigned to the thread.
+        bool woken = false;                 ///< @brief True if the thread was asked to wake up.
+        std::condition_variable cv;         ///< @brief Condition variable to wake up the thread.
+    };
+
+    std::vector<Worker*> workers;           ///< @brief Worker threads.
+    std::unordered_map<GraphViewer*, Worker*> assigned; ///< @brief Worker of each window.
+    std::mutex schedulerMutex;              ///< @brief Mutex protecting assigned, and added, removed, count and woken of workers.
+    std::condition_variable removedCV;      ///< @brief Signalled when a window was removed.
+    std::atomic<bool> stopping{false};      ///< @brief True if threads should stop.
+    std::atomic<unsigned> frameRate{60};    ///< @brief Frame rate of windows without framerate limit.
+
+    /**
+     * @brief Body of a worker thread.
+     *
+     * @param worker    Worker
+     */
+    void work(Worker *worker);
+
+    /**
+     * @brief Stop servicing a window that was closed by a worker.
+     *
+     * @param worker    Worker
+     * @param graph     Graph
+     */
+    void closed(Worker *worker, GraphViewer *graph);
+
+public:
+    /**
+     * @brief Construct a new RenderScheduler and start its threads.
+     *
+     * @param threads   Number of threads; limited to the number of hardware
+     *                  threads, and at least 1
+     */
+    explicit RenderScheduler(unsigned threads = 1);
+
+    RenderScheduler(const RenderScheduler&) = delete;
+    RenderScheduler& operator=(const RenderScheduler&) = delete;
+
+    /**
+     * @brief Stop all threads, closing any windows still open.
+     */
+    ~RenderScheduler();
+
+    /**
+     * @brief Set frame rate of windows that have no framerate limit.
+     *
+     * @param fps   Frames per second, or 0 to draw them as often as possible
+     */
+    void setFrameRate(unsigned fps = 60);
+
+    /**
+     * @brief Get number of threads.
+     *
+     * @return size_t   Number of threads
+     */
+    size_t getThreads() const;
+
+    /**
+     * @brief Open the window of a graph, in one of the threads.
+     *
+     * Returns immediately; the window is opened by that thread.
+     *
+     * @param graph     Graph
+     */
+    void add(GraphViewer *graph);
+
+    /**
+     * @brief Close the window of a graph, and stop servicing it.
+     *
+     * Waits until the thread of the window has closed it. Does nothing if the
+     * window is not serviced by this scheduler.
+     *
+     * @param graph     Graph
+     */
+    void remove(GraphViewer *graph);
+
+    /**
+     * @brief Wake up the thread of a window, e.g. because a redraw was
+     *        requested.
+     *
+     * @param graph     Graph
+     */
+    void wake(GraphViewer *graph);
+};
+
+#endif // RENDER_SCHEDULER_H_INCLUDED
@@ -0,0 +1,196 @@
+#ifndef SPATIAL_GRID_H_INCLUDED
+#define SPATIAL_GRID_H_INCLUDED
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+/**
+ * @brief Uniform grid to index items by their bounding boxes.
+ *
+ * Each item is registered in all cells its bounding box overlaps, so finding
+ * the items that intersect a rectangle only visits the cells covered by that
+ * rectangle. Items whose bounding box covers too many cells are kept in a
+ * separate list that is checked in every query.
+ *
+ * @tparam T Item type; must be hashable (e.g., a pointer)
+ */
+template<class T>
+class SpatialGrid {
+private:
+    /**
+     * @brief Maximum number of cells an item may span before it is
+     *        considered oversized.
+     */
+    static const int64_t MAX_ITEM_CELLS = 64;
+
+    /**
+     * @brief Information about an indexed item.
+     */
+    struct Entry {
+        T item;                     ///< @brief Item.
+        sf::FloatRect bounds;       ///< @brief Bounding box of item.
+        int32_t x0, y0, x1, y1;     ///< @brief Range of cells the item is in (inclusive).
+        bool oversized;             ///< @brief True if item is in the oversized list.
+        size_t oversizedIndex;      ///< @brief Index of item in the oversized list.
+        unsigned stamp;             ///< @brief Last query that visited this item.
+    };
+
+    float cellSize;                                         ///< @brief Width/height of a cell.
+    std::unordered_map<T, Entry> entries;                   ///< @brief Indexed items.
+    std::unordered_map<int64_t, std::vector<Entry*>> cells; ///< @brief Items in each cell.
+    std::vector<Entry*> oversized;                          ///< @brief Items spanning too many cells.
+    unsigned stamp = 0;                                     ///< @brief Current query stamp.
+
+    static int64_t key(int32_t x, int32_t y){
+        return (int64_t(x) << 32) | int64_t(uint32_t(y));
+    }
+
+    int32_t cell(float coord) const {
+        return int32_t(std::floor(coord/cellSize));
+    }
+
+    void link(Entry &e){
+        if(int64_t(e.x1-e.x0+1)*int64_t(e.y1-e.y0+1) > MAX_ITEM_CELLS){
+            e.oversized = true;
+            e.oversizedIndex = oversized.size();
+            oversized.push_back(&e);
+            return;
+        }
+        e.oversized = false;
+        for(int32_t x = e.x0; x <= e.x1; ++x)
+            for(int32_t y = e.y0; y <= e.y1; ++y)
+                cells[key(x, y)].push_back(&e);
+    }
+
+    void unlink(Entry &e){
+        if(e.oversized){
+            oversized[e.oversizedIndex] = oversized.back();
+            oversized[e.oversizedIndex]->oversizedIndex = e.oversizedIndex;
+            oversized.pop_back();
+            return;
+        }
+        for(int32_t x = e.x0; x <= e.x1; ++x){
+            for(int32_t y = e.y0; y <= e.y1; ++y){
+                auto it = cells.find(key(x, y));
+                std::vector<Entry*> &v = it->second;
+                for(size_t i = 0; i < v.size(); ++i){
+                    if(v[i] == &e){
+                        v[i] = v.back();
+                        v.pop_back();
+                        break;
+                    }
+                }
+                if(v.empty()) cells.erase(it);
+            }
+        }
+    }
+
+    void visit(Entry *e, const sf::FloatRect &rect, std::vector<T> &out){
+        if(e->stamp == stamp) return;
+        e->stamp = stamp;
+        if(e->bounds.intersects(rect)) out.push_back(e->item);
+    }
+
+public:
+    /**
+     * @brief Construct a new SpatialGrid.
+     *
+     * @param cellSize  Width/height of each cell; should be a few times the
+     *                  size of typical items
+     */
+    explicit SpatialGrid(float cellSize = 256.0f):
+        cellSize(cellSize)
+    {}
+
+    /**
+     * @brief Insert item, or update its bounding box if already indexed.
+     *
+     * @param item      Item
+     * @param bounds    Bounding box of item
+     */
+    void insert(const T &item, const sf::FloatRect &bounds){
+        int32_t x0 = cell(bounds.left), x1 = cell(bounds.left+bounds.width );
+        int32_t y0 = cell(bounds.top ), y1 = cell(bounds.top +bounds.height);
+        auto it = entries.find(item);
+        if(it != entries.end()){
+            Entry &e = it->second;
+            e.bounds = bounds;
+            if(e.x0 == x0 && e.y0 == y0 && e.x1 == x1 && e.y1 == y1) return;
+            unlink(e);
+            e.x0 = x0; e.y0 = y0; e.x1 = x1; e.y1 = y1;
+            link(e);
+        } else {
+            Entry &e = entries[item];
+            e.item = item;
+            e.bounds = bounds;
+            e.x0 = x0; e.y0 = y0; e.x1 = x1; e.y1 = y1;
+            e.stamp = stamp;
+            link(e);
+        }
+    }
+
+    /**
+     * @brief Remove item; does nothing if the item is not indexed.
+     *
+     * @param item  Item
+     */
+    void remove(const T &item){
+        auto it = entries.find(item);
+        if(it == entries.end()) return;
+        unlink(it->second);
+        entries.erase(it);
+    }
+
+    /**
+     * @brief Find all items whose bounding boxes intersect a rectangle.
+     *
+     * @param rect  Rectangle
+     * @param out   Vector where items are appended; each item is appended
+     *              only once
+     */
+    void query(const sf::FloatRect &rect, std::vector<T> &out){
+        ++stamp;
+        int32_t x0 = cell(rect.left), x1 = cell(rect.left+rect.width );
+        int32_t y0 = cell(rect.top ), y1 = cell(rect.top +rect.height);
+        if(int64_t(x1-x0+1)*int64_t(y1-y0+1) > int64_t(cells.size())){
+            for(auto &p: cells)
+                for(Entry *e: p.second)
+                    visit(e, rect, out);
+        } else {
+            for(int32_t x = x0; x <= x1; ++x){
+                for(int32_t y = y0; y <= y1; ++y){
+                    auto it = cells.find(key(x, y));
+                    if(it == cells.end()) continue;
+                    for(Entry *e: it->second)
+                        visit(e, rect, out);
+                }
+            }
+        }
+        for(Entry *e: oversized)
+            visit(e, rect, out);
+    }
+
+    /**
+     * @brief Remove all items.
+     */
+    void clear(){
+        entries.clear();
+        cells.clear();
+        oversized.clear();
+    }
+
+    /**
+     * @brief Get number of indexed items.
+     *
+     * @return size_t   Number of items
+     */
+    size_t size() const {
+        return entries.size();
+    }
+};
+
+#endif // SPATIAL_GRID_H_INCLUDED
@@ -0,0 +1,126 @@
+#ifndef TEXTURE_CACHE_H_INCLUDED
+#define TEXTURE_CACHE_H_INCLUDED
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <SFML/Graphics.hpp>
+
+/**
+ * @brief Process-wide cache of textures loaded from files.
+ *
+ * Each file is loaded once, and shared by all users of the same path for as
+ * long as any of them holds it; the texture is freed when the last user
+ * releases it.
+ *
+ * Optionally, small images are packed into atlas textures instead of having
+ * a texture each, so that everything using them can be drawn with a single
+ * draw call per atlas.
+ */
+class TextureCache {
+public:
+    /**
+     * @brief Texture loaded from a file.
+     */
+    class Entry {
+    private:
+        friend TextureCache;
+        std::shared_ptr<sf::Texture> texture;   ///< @brief Texture the image is in; shared by all images of an atlas.
+        sf::IntRect rect;                       ///< @brief Region of the texture holding the image.
+    public:
+        /**
+         * @brief Get texture the image is in.
+         *
+         * @return const sf::Texture&   Texture
+         */
+        const sf::Texture& getTexture() const;
+        /**
+         * @brief Get region of the texture holding the image.
+         *
+         * @return const sf::IntRect&   Region, in pixels
+         */
+        const sf::IntRect& getTextureRect() const;
+    };
+
+    /**
+     * @brief Reference to a cached texture; the texture is kept alive while
+     *        any reference to it exists.
+     */
+    typedef std::shared_ptr<const Entry> Handle;
+
+private:
+    static const unsigned ATLAS_SIZE = 2048;    ///< @brief Width/height of atlas textures, in pixels.
+    static const unsigned ATLAS_PADDING = 1;    ///< @brief Spacing between images in an atlas, in pixels.
+
+    mutable std::mutex cacheMutex;              ///< @brief Mutex protecting all members.
+    std::unordered_map<std::string, std::weak_ptr<const Entry>> entries; ///< @brief Cached textures, by path.
+    size_t cleanupSize = 16;                    ///< @brief Number of entries at which released entries are dropped.
+    unsigned long hits = 0;                     ///< @brief Number of requests found in the cache.
+    unsigned long misses = 0;                   ///< @brief Number of requests loaded from file.
+
+    bool atlas = false;                         ///< @brief True if small images are packed in atlases.
+    unsigned atlasMaxSize = 128;                ///< @brief Maximum width/height of images packed in atlases.
+    std::shared_ptr<sf::Texture> atlasPage;     ///< @brief Atlas texture being filled.
+    unsigned atlasX = 0;                        ///< @brief Left of free space in current atlas row.
+    unsigned atlasY = 0;                        ///< @brief Top of current atlas row.
+    unsigned atlasRowHeight = 0;                ///< @brief Height of current atlas row.
+
+    TextureCache() = default;
+
+    /**
+     * @brief Place image in an atlas.
+     *
+     * @param image     Image
+     * @param entry     Entry to be set to the region of the atlas
+     */
+    void pack(const sf::Image &image, Entry &entry);
+
+public:
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    /**
+     * @brief Get the process-wide cache.
+     *
+     * @return TextureCache&    Cache
+     */
+    static TextureCache& getInstance();
+
+    /**
+     * @brief Get texture of a file, loading it if it is not cached.
+     *
+     * @param path      Path of image file
+     * @return Handle   Reference to the texture
+     *
+     * @throws std::runtime_error   If the file could not be loaded
+     */
+    Handle get(const std::string &path);
+
+    /**
+     * @brief Pack small images in atlases.
+     *
+     * Only affects images loaded afterwards.
+     *
+     * @param b         True to pack images in atlases, false otherwise
+     * @param maxSize   Maximum width/height of images to be packed, in pixels
+     */
+    void setAtlas(bool b, unsigned maxSize = 128);
+
+    /**
+     * @brief Get number of cached textures, i.e., with at least one reference.
+     *
+     * @return size_t   Number of textures
+     */
+    size_t getSize() const;
+
+    /**
+     * @brief Get fraction of requests that were found in the cache.
+     *
+     * @return float    Hit rate, between 0 and 1; 0 if there were no requests
+     */
+    float getHitRate() const;
+};
+
+#endif // TEXTURE_CACHE_H_INCLUDED
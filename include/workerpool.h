@@ -0,0 +1,81 @@
+#ifndef WORKER_POOL_H_INCLUDED
+#define WORKER_POOL_H_INCLUDED
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Process-wide pool of threads to run loops in parallel.
+ *
+ * Threads are started when first needed and kept until the process exits,
+ * so loops run every frame do not create and join threads each time. The
+ * thread calling WorkerPool::parallelFor() also runs part of the loop.
+ * One loop runs at a time; concurrent calls wait for their turn, so f must
+ * not call parallelFor() itself.
+ */
+class WorkerPool {
+public:
+    typedef std::function<void(size_t, size_t)> Range; ///< @brief Function called on a range [begin, end).
+
+    static const size_t MIN_CHUNK_SIZE = 1024;  ///< @brief Default minimum number of iterations per thread.
+
+private:
+    std::vector<std::thread> helpers;           ///< @brief Helper threads.
+    std::mutex runMutex;                        ///< @brief Mutex held while a loop runs, so only one runs at a time.
+    std::mutex jobMutex;                        ///< @brief Mutex protecting all members below.
+    std::condition_variable jobCV;              ///< @brief Signalled when a loop starts, or the pool stops.
+    std::condition_variable doneCV;             ///< @brief Signalled when the last chunk of a loop is done.
+    const Range *job = nullptr;                 ///< @brief Function of the running loop.
+    size_t jobSize = 0;                         ///< @brief Number of iterations of the running loop.
+    size_t numChunks = 0;                       ///< @brief Number of chunks the running loop is split into.
+    size_t nextChunk = 0;                       ///< @brief Next chunk to be run.
+    size_t pendingChunks = 0;                   ///< @brief Number of chunks not yet finished.
+    std::exception_ptr exception;               ///< @brief First exception thrown by a chunk of the running loop.
+    bool stopping = false;                      ///< @brief True if helper threads should stop.
+
+    WorkerPool() = default;
+
+    /**
+     * @brief Body of helper threads.
+     */
+    void work();
+    /**
+     * @brief Run chunks of the running loop until none is left.
+     *
+     * @param lock  Lock of jobMutex; unlocked while chunks run
+     */
+    void runChunks(std::unique_lock<std::mutex> &lock);
+
+public:
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool();
+
+    /**
+     * @brief Get the process-wide pool.
+     *
+     * @return WorkerPool&  Pool
+     */
+    static WorkerPool& getInstance();
+
+    /**
+     * @brief Call f(begin, end) on disjoint ranges covering [0, n), in
+     *        parallel if n is large; returns once all calls returned.
+     *
+     * If any call throws, the remaining ranges are still run, and the first
+     * exception is rethrown once all calls returned.
+     *
+     * @param n             Number of iterations
+     * @param f             Function called on each range
+     * @param maxThreads    Maximum number of threads, or 0 for all hardware
+     *                      threads
+     * @param minChunkSize  Minimum number of iterations per thread
+     */
+    void parallelFor(size_t n, const Range &f, unsigned maxThreads = 0, size_t minChunkSize = MIN_CHUNK_SIZE);
+};
+
+#endif // WORKER_POOL_H_INCLUDED
@@ -0,0 +1,333 @@
+#include "graphviewer.h"
+#include "mappedfile.h"
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+using namespace sf;
+
+/*
+ * Binary graph file layout (little-endian, every section starts at a
+ * multiple of 8 bytes):
+ *
+ *   Header
+ *   String table   uint64 offsets[stringCount+1], char bytes[stringBytes]
+ *   Nodes          int64 id[N], float x[N], float y[N], uint32 color[N],
+ *                  float size[N], uint32 label[N], uint32 icon[N]
+ *   Edges          int64 id[E], int64 u[E], int64 v[E], uint32 color[E],
+ *                  float thickness[E], uint32 label[E], float weight[E],
+ *                  float flow[E], uint8 flags[E]
+ *   Geometry       uint64 offsets[E+1], float xy[2*vertexCount]
+ *                  (only if FLAG_GEOMETRY is set)
+ *
+ * Labels and icons are indices into the string table; string 0 is always
+ * the empty string.
+ */
+
+namespace {
+    const char MAGIC[4] = {'G', 'V', 'B', 'G'};
+    const uint32_t VERSION = 1;
+
+    const uint32_t FLAG_GEOMETRY = 1u << 0;
+
+    const uint8_t EDGE_DIRECTED = 1u << 0;
+    const uint8_t EDGE_DASHED   = 1u << 1;
+    const uint8_t EDGE_WEIGHT   = 1u << 2;
+    const uint8_t EDGE_FLOW     = 1u << 3;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t reserved;
+        uint64_t nodeCount;
+        uint64_t edgeCount;
+        uint64_t stringCount;
+        uint64_t stringBytes;
+        uint64_t vertexCount;
+    };
+
+    uint64_t align(uint64_t n){
+        return (n + 7) & ~uint64_t(7);
+    }
+
+    /**
+     * @brief Sequential reader of the sections of a mapped file.
+     */
+    class Reader {
+    private:
+        const char *data;
+        uint64_t size;
+        uint64_t offset = 0;
+    public:
+        Reader(const char *data, uint64_t size):
+            data(data), size(size)
+        {}
+
+        template<class T>
+        const T* read(uint64_t n){
+            if(n > (size - offset)/sizeof(T))
+                throw runtime_error("Binary graph file is truncated");
+            const T *ret = reinterpret_cast<const T*>(data + offset);
+            offset = min(size, align(offset + n*sizeof(T)));
+            return ret;
+        }
+    };
+
+    /**
+     * @brief Writer of sections to a file.
+     */
+    class Writer {
+    private:
+        ofstream os;
+        uint64_t offset = 0;
+    public:
+        explicit Writer(const string &path):
+            os(path, ios::binary)
+        {
+            if(!os) throw runtime_error("Could not open file " + path);
+        }
+
+        template<class T>
+        void write(const vector<T> &v){
+            write(v.data(), v.size());
+        }
+
+        template<class T>
+        void write(const T *p, uint64_t n){
+            static const char padding[8] = {};
+            os.write(reinterpret_cast<const char*>(p), streamsize(n*sizeof(T)));
+            uint64_t end = offset + n*sizeof(T);
+            offset = align(end);
+            os.write(padding, streamsize(offset - end));
+        }
+
+        void close(){
+            os.close();
+            if(!os) throw runtime_error("Could not write binary graph file");
+        }
+    };
+
+    /**
+     * @brief Table of distinct strings.
+     */
+    class StringTable {
+    private:
+        unordered_map<string, uint32_t> indices;
+    public:
+        vector<uint64_t> offsets;
+        string bytes;
+
+        StringTable(){
+            get("");
+        }
+
+        uint32_t get(const string &s){
+            auto it = indices.emplace(s, uint32_t(indices.size()));
+            if(it.second){
+                if(offsets.empty()) offsets.push_back(0);
+                bytes += s;
+                offsets.push_back(bytes.size());
+            }
+            return it.first->second;
+        }
+    };
+}
+
+void GraphViewer::saveBinary(const string &path, bool geometry){
+    lock_guard<mutex> lock(graphMutex);
+    flushUpdates();
+
+    const size_t N = nodePool.size();
+    const size_t E = edgePool.size();
+
+    StringTable strings;
+
+    vector<int64_t > nodeId   ; nodeId   .reserve(N);
+    vector<float   > nodeX    ; nodeX    .reserve(N);
+    vector<float   > nodeY    ; nodeY    .reserve(N);
+    vector<uint32_t> nodeColor; nodeColor.reserve(N);
+    vector<float   > nodeSize ; nodeSize .reserve(N);
+    vector<uint32_t> nodeLabel; nodeLabel.reserve(N);
+    vector<uint32_t> nodeIcon ; nodeIcon .reserve(N);
+    for(const Node &n: nodePool){
+        const Node *node = &n;
+        nodeId   .push_back(node->getId());
+        nodeX    .push_back(node->getPosition().x);
+        nodeY    .push_back(node->getPosition().y);
+        nodeColor.push_back(node->getColor().toInteger());
+        nodeSize .push_back(node->getSize());
+        nodeLabel.push_back(strings.get(node->getLabel()));
+        nodeIcon .push_back(strings.get(node->getIsIcon() ? node->iconPath : ""));
+    }
+
+    vector<int64_t > edgeId       ; edgeId       .reserve(E);
+    vector<int64_t > edgeU        ; edgeU        .reserve(E);
+    vector<int64_t > edgeV        ; edgeV        .reserve(E);
+    vector<uint32_t> edgeColor    ; edgeColor    .reserve(E);
+    vector<float   > edgeThickness; edgeThickness.reserve(E);
+    vector<uint32_t> edgeLabel    ; edgeLabel    .reserve(E);
+    vector<float   > edgeWeight   ; edgeWeight   .reserve(E);
+    vector<float   > edgeFlow     ; edgeFlow     .reserve(E);
+    vector<uint8_t > edgeFlags    ; edgeFlags    .reserve(E);
+    vector<uint64_t> vertexOffsets;
+    vector<float   > vertices;
+    if(geometry){
+        vertexOffsets.reserve(E+1);
+        vertexOffsets.push_back(0);
+    }
+    for(const Edge &e: edgePool){
+        const Edge *edge = &e;
+        uint8_t flags = 0;
+        if(edge->getEdgeType() == Edge::EdgeType::DIRECTED) flags |= EDGE_DIRECTED;
+        if(edge->getDashed())                               flags |= EDGE_DASHED;
+        if(edge->getWeight() != nullptr)                    flags |= EDGE_WEIGHT;
+        if(edge->getFlow  () != nullptr)                    flags |= EDGE_FLOW;
+        edgeId       .push_back(edge->getId());
+        edgeU        .push_back(edge->getFrom()->getId());
+        edgeV        .push_back(edge->getTo  ()->getId());
+        edgeColor    .push_back(edge->getColor().toInteger());
+        edgeThickness.push_back(edge->getThickness());
+        edgeLabel    .push_back(strings.get(edge->getLabel()));
+        edgeWeight   .push_back(edge->getWeight() != nullptr ? *edge->getWeight() : 0.0f);
+        edgeFlow     .push_back(edge->getFlow  () != nullptr ? *edge->getFlow  () : 0.0f);
+        edgeFlags    .push_back(flags);
+        if(geometry){
+            const VertexArray *shape = edge->getShape();
+            if(shape != nullptr){
+                for(size_t i = 0; i < shape->getVertexCount(); ++i){
+                    vertices.push_back((*shape)[i].position.x);
+                    vertices.push_back((*shape)[i].position.y);
+                }
+            }
+            vertexOffsets.push_back(vertices.size()/2);
+        }
+    }
+
+    if(strings.offsets.size()-1 > numeric_limits<uint32_t>::max())
+        throw runtime_error("Too many distinct strings for a binary graph file");
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version     = VERSION;
+    header.flags       = (geometry ? FLAG_GEOMETRY : 0);
+    header.reserved    = 0;
+    header.nodeCount   = N;
+    header.edgeCount   = E;
+    header.stringCount = strings.offsets.size()-1;
+    header.stringBytes = strings.bytes.size();
+    header.vertexCount = vertices.size()/2;
+
+    Writer w(path);
+    w.write(&header, 1);
+    w.write(strings.offsets);
+    w.write(strings.bytes.data(), strings.bytes.size());
+    w.write(nodeId); w.write(nodeX); w.write(nodeY); w.write(nodeColor); w.write(nodeSize); w.write(nodeLabel); w.write(nodeIcon);
+    w.write(edgeId); w.write(edgeU); w.write(edgeV); w.write(edgeColor); w.write(edgeThickness); w.write(edgeLabel); w.write(edgeWeight); w.write(edgeFlow); w.write(edgeFlags);
+    if(geometry){
+        w.write(vertexOffsets);
+        w.write(vertices);
+    }
+    w.close();
+}
+
+void GraphViewer::loadBinary(const string &path){
+    MappedFile file(path);
+    Reader r(file.getData(), file.getSize());
+
+    const Header &header = *r.read<Header>(1);
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+        throw runtime_error("Not a binary graph file: " + path);
+    if(header.version != VERSION)
+        throw runtime_error("Unsupported binary graph file version: " + to_string(header.version));
+    if(header.nodeCount > file.getSize() || header.edgeCount   > file.getSize() ||
+       header.stringCount > file.getSize() || header.vertexCount > file.getSize())
+        throw runtime_error("Binary graph file is truncated");
+    if(header.stringCount == 0)
+        throw runtime_error("Binary graph file has an invalid string table");
+
+    const uint64_t N = header.nodeCount;
+    const uint64_t E = header.edgeCount;
+    const uint64_t S = header.stringCount;
+
+    const uint64_t *stringOffsets = r.read<uint64_t>(S+1);
+    const char     *stringBytes   = r.read<char    >(header.stringBytes);
+    if(stringOffsets[0] != 0 || stringOffsets[S] != header.stringBytes)
+        throw runtime_error("Binary graph file has an invalid string table");
+    vector<string> strings(S);
+    for(uint64_t i = 0; i < S; ++i){
+        if(stringOffsets[i] > stringOffsets[i+1])
+            throw runtime_error("Binary graph file has an invalid string table");
+        strings[i].assign(stringBytes + stringOffsets[i], stringOffsets[i+1]-stringOffsets[i]);
+    }
+    auto getString = [&strings, S](uint32_t i) -> const string& {
+        if(i >= S) throw runtime_error("Binary graph file has an invalid string index");
+        return strings[i];
+    };
+
+    const int64_t  *nodeId    = r.read<int64_t >(N);
+    const float    *nodeX     = r.read<float   >(N);
+    const float    *nodeY     = r.read<float   >(N);
+    const uint32_t *nodeColor = r.read<uint32_t>(N);
+    const float    *nodeSize  = r.read<float   >(N);
+    const uint32_t *nodeLabel = r.read<uint32_t>(N);
+    const uint32_t *nodeIcon  = r.read<uint32_t>(N);
+
+    const int64_t  *edgeId        = r.read<int64_t >(E);
+    const int64_t  *edgeU         = r.read<int64_t >(E);
+    const int64_t  *edgeV         = r.read<int64_t >(E);
+    const uint32_t *edgeColor     = r.read<uint32_t>(E);
+    const float    *edgeThickness = r.read<float   >(E);
+    const uint32_t *edgeLabel     = r.read<uint32_t>(E);
+    const float    *edgeWeight    = r.read<float   >(E);
+    const float    *edgeFlow      = r.read<float   >(E);
+    const uint8_t  *edgeFlags     = r.read<uint8_t >(E);
+
+    const uint64_t *vertexOffsets = nullptr;
+    const float    *vertices      = nullptr;
+    if(header.flags & FLAG_GEOMETRY){
+        vertexOffsets = r.read<uint64_t>(E+1);
+        vertices      = r.read<float   >(2*header.vertexCount);
+        if(vertexOffsets[0] != 0 || vertexOffsets[E] != header.vertexCount)
+            throw runtime_error("Binary graph file has invalid edge geometry");
+    }
+
+    vector<NodeDescriptor> nodeDescriptors(N);
+    for(uint64_t i = 0; i < N; ++i){
+        NodeDescriptor &d = nodeDescriptors[i];
+        d.id       = nodeId[i];
+        d.position = Vector2f(nodeX[i], nodeY[i]);
+        d.color    = Color(nodeColor[i]);
+        d.size     = nodeSize[i];
+        d.label    = getString(nodeLabel[i]);
+        d.icon     = getString(nodeIcon [i]);
+    }
+
+    vector<EdgeDescriptor> edgeDescriptors(E);
+    for(uint64_t i = 0; i < E; ++i){
+        EdgeDescriptor &d = edgeDescriptors[i];
+        d.id        = edgeId[i];
+        d.u         = edgeU[i];
+        d.v         = edgeV[i];
+        d.edge_type = (edgeFlags[i] & EDGE_DIRECTED ? Edge::EdgeType::DIRECTED : Edge::EdgeType::UNDIRECTED);
+        d.color     = Color(edgeColor[i]);
+        d.thickness = edgeThickness[i];
+        d.label     = getString(edgeLabel[i]);
+        d.dashed    = (edgeFlags[i] & EDGE_DASHED);
+        d.hasWeight = (edgeFlags[i] & EDGE_WEIGHT);
+        d.weight    = edgeWeight[i];
+        d.hasFlow   = (edgeFlags[i] & EDGE_FLOW);
+        d.flow      = edgeFlow[i];
+        if(vertexOffsets != nullptr){
+            if(vertexOffsets[i] > vertexOffsets[i+1])
+                throw runtime_error("Binary graph file has invalid edge geometry");
+            d.geometry     = vertices + 2*vertexOffsets[i];
+            d.geometrySize = vertexOffsets[i+1] - vertexOffsets[i];
+        }
+    }
+
+    addGraph(nodeDescriptors, edgeDescriptors);
+}
@@ -1,62 +1,111 @@
 #include "graphviewer.h"
 
+#include <algorithm>
 #include <cmath>
 
 using namespace std;
 using namespace sf;
 
+static const Text EMPTY_TEXT;
+
 GraphViewer::Edge::Edge(
     GraphViewer::id_t id,
     GraphViewer::Node &u,
     GraphViewer::Node &v,
     GraphViewer::Edge::EdgeType edge_type
 ):
+    graph(u.graph),
     id(id),
     u(&u),
     v(&v),
     edge_type(edge_type)
 {
-    u.edges.insert(this);
-    v.edges.insert(this);
+    attach();
+}
+
+void GraphViewer::Edge::attach(){
+    uIndex = u->edges.size();
+    u->edges.push_back(this);
+    if(v != u){
+        vIndex = v->edges.size();
+        v->edges.push_back(this);
+    }
+}
+
+void GraphViewer::Edge::detach(){
+    // Move the last edge of the node into the place of this edge
+    auto remove = [](Node *node, size_t i){
+        Edge *last = node->edges.back();
+        node->edges[i] = last;
+        node->edges.pop_back();
+        if(last->u == node) last->uIndex = i;
+        else                last->vIndex = i;
+    };
+    remove(u, uIndex);
+    if(v != u) remove(v, vIndex);
+}
 
-    text.setFont(GraphViewer::FONT);
-    text.setCharacterSize(GraphViewer::FONT_SIZE);
-    text.setFillColor(Color::Black);
-    
-    update();
+GraphViewer::Edge::~Edge(){
+    delete shape;
 }
 
         GraphViewer::id_t           GraphViewer::Edge::getId        (                                       ) const { return id; }
-        void                        GraphViewer::Edge::setFrom      (Node *u                                )       { this->u->edges.erase(this); this->u = u; this->u->edges.insert(this); update(); }
+        void                        GraphViewer::Edge::setFrom      (Node *u                                )       { detach(); this->u = u; attach(); invalidate(); }
 const   GraphViewer::Node*          GraphViewer::Edge::getFrom      (                                       ) const { return u; }
-        void                        GraphViewer::Edge::setTo        (Node *v                                )       { this->v->edges.erase(this); this->v = v; this->v->edges.insert(this); update(); }
+        void                        GraphViewer::Edge::setTo        (Node *v                                )       { detach(); this->v = v; attach(); invalidate(); }
 const   GraphViewer::Node*          GraphViewer::Edge::getTo        (                                       ) const { return v; }
-        void                        GraphViewer::Edge::setEdgeType  (GraphViewer::Edge::EdgeType edge_type  )       { this->edge_type = edge_type; update(); }
+const   GraphViewer::Node*          GraphViewer::Edge::getOpposite  (const Node *node                       ) const { return (node == u ? v : u); }
+        void                        GraphViewer::Edge::setEdgeType  (GraphViewer::Edge::EdgeType edge_type  )       { this->edge_type = edge_type; invalidate(); }
         GraphViewer::Edge::EdgeType GraphViewer::Edge::getEdgeType  (                                       ) const { return edge_type; }
-        void                        GraphViewer::Edge::setLabel     (const string &label                    )       { this->label = label; update(); }
+        void                        GraphViewer::Edge::setLabel     (const string &label                    )       { this->label = label; invalidate(); }
         string                      GraphViewer::Edge::getLabel     (                                       ) const { return label; }
-void                                GraphViewer::Edge::setLabelColor(const Color &color                     )       { text.setFillColor(color); update(); }
-const   sf::Color&                  GraphViewer::Edge::getLabelColor(                                       ) const { return text.getFillColor(); }
-        void                        GraphViewer::Edge::setLabelSize (unsigned int size                      )       { text.setCharacterSize(size); update(); }
-        unsigned                    GraphViewer::Edge::getLabelSize (                                       ) const { return text.getCharacterSize(); }
-        void                        GraphViewer::Edge::setColor     (const Color &color                     )       { this->color = color; update(); }
+void                                GraphViewer::Edge::setLabelColor(const Color &color                     )       { labelColor = color; invalidate(); }
+const   sf::Color&                  GraphViewer::Edge::getLabelColor(                                       ) const { return labelColor; }
+        void                        GraphViewer::Edge::setLabelSize (unsigned int size                      )       { labelSize = size; invalidate(); }
+        unsigned                    GraphViewer::Edge::getLabelSize (                                       ) const { return labelSize; }
+        void                        GraphViewer::Edge::setColor     (const Color &color                     )       { this->color = color; invalidate(); }
 const   Color&                      GraphViewer::Edge::getColor     (                                       ) const { return color; }
-        void                        GraphViewer::Edge::setDashed    (bool dashed                            )       { this->dashed = dashed; update(); }
+        void                        GraphViewer::Edge::setDashed    (bool dashed                            )       { this->dashed = dashed; invalidate(); }
         bool                        GraphViewer::Edge::getDashed    (                                       ) const { return dashed; }
-        void                        GraphViewer::Edge::setThickness (float thickness                        )       { this->thickness = thickness; update(); }
+        void                        GraphViewer::Edge::setThickness (float thickness                        )       { this->thickness = thickness; invalidate(); }
         float                       GraphViewer::Edge::getThickness (                                       ) const { return thickness; }
-        void                        GraphViewer::Edge::setWeight    (float weight                           )       { delete this->weight; this->weight = new float(weight); update(); }
-const   float*                      GraphViewer::Edge::getWeight    (                                       ) const { return weight; }
-        void                        GraphViewer::Edge::setFlow      (float flow                             )       { delete this->flow; this->flow = new float(flow); update(); }
-const   float*                      GraphViewer::Edge::getFlow      (                                       ) const { return flow; }
+        void                        GraphViewer::Edge::setWeight    (float weight                           )       { this->weight = weight; hasWeight = true; invalidate(); }
+const   float*                      GraphViewer::Edge::getWeight    (                                       ) const { return (hasWeight ? &weight : nullptr); }
+        void                        GraphViewer::Edge::setFlow      (float flow                             )       { this->flow = flow; hasFlow = true; invalidate(); }
+const   float*                      GraphViewer::Edge::getFlow      (                                       ) const { return (hasFlow ? &flow : nullptr); }
 const   VertexArray*                GraphViewer::Edge::getShape     (                                       ) const { return shape; }
-const   Text&                       GraphViewer::Edge::getText      (                                       ) const { return text; }
+const   Text&                       GraphViewer::Edge::getText      (                                       ) const { if(text == nullptr) return EMPTY_TEXT; layoutText(); return *text; }
 
 void GraphViewer::Edge::update(){
-    delete shape;
-    shape = nullptr;
+    updateShape();
+    updateText();
+    updateGraph();
+}
 
-    if(getThickness() <= 0.0) return;
+void GraphViewer::Edge::updateShape(){
+    if(getThickness() <= 0.0){
+        delete shape;
+        shape = nullptr;
+        return;
+    }
+    // Reuse the vertex array, so moving an edge does not allocate memory
+    if(shape == nullptr){
+        shape = new LineShape(u->getPosition(), v->getPosition(), 0);
+    } else {
+        shape->setFrom(u->getPosition());
+        shape->setTo  (v->getPosition());
+    }
+
+    // Textured dashes are full lines with texture coordinates, so their
+    // vertex count does not depend on their length
+    if(!getDashed() || graph->texturedDashes){
+        bool arrows = (edge_type == EdgeType::DIRECTED);
+        size_t n = LineBatch::getVertexCount(arrows);
+        shape->resize(n);
+        LineBatch::buildLine(u->getPosition(), v->getPosition(), u->getSize()/2.0f, v->getSize()/2.0f, getThickness(), getColor(), arrows, &(*shape)[0]);
+        if(getDashed()) DashedLineShape::setTexCoords(&(*shape)[0], n, getThickness());
+        return;
+    }
 
     sf::Vector2f uPos = u->getPosition();
     sf::Vector2f vPos = v->getPosition();
@@ -65,33 +114,135 @@ void GraphViewer::Edge::update(){
     uPos = uPos + uvUVec*(u->getSize()/2.0f);
     vPos = vPos - uvUVec*(v->getSize()/2.0f);
 
-    shape = new LineShape(uPos, vPos, 0);
+    shape->resize(0);
     if(edge_type == EdgeType::DIRECTED){
         ArrowHead arrow(uPos, vPos, getThickness());
         shape->append(arrow);
         vPos = arrow.getLineConnection();
     }
-    if(!getDashed()){
-        shape->append(FullLineShape(uPos, vPos, getThickness()));
-    } else {
-        shape->append(DashedLineShape(uPos, vPos, getThickness()));
+    shape->append(DashedLineShape(uPos, vPos, getThickness(), graph->dashFill));
+    shape->setFillColor(getColor());
+}
+
+void GraphViewer::Edge::setShape(const float *positions, size_t n){
+    // Precomputed geometry has no texture coordinates
+    if(getDashed() && graph->texturedDashes){
+        updateShape();
+        return;
     }
+    delete shape;
+    shape = nullptr;
+
+    if(getThickness() <= 0.0) return;
+
+    shape = new LineShape(u->getPosition(), v->getPosition(), 0);
+    for(size_t i = 0; i < n; ++i)
+        shape->append(Vertex(Vector2f(positions[2*i], positions[2*i+1])));
     shape->setFillColor(getColor());
+}
+
+void GraphViewer::Edge::updateText(){
+    if(label.empty() && !hasWeight && !hasFlow){
+        text = nullptr;
+        textDirty = false;
+        return;
+    }
+    if(text == nullptr){
+        text.reset(new Text());
+        text->setFont(GraphViewer::FONT);
+    }
+    textDirty = true;
+}
 
+void GraphViewer::Edge::layoutText() const {
+    if(!textDirty) return;
+    textDirty = false;
     string tmpLabel = getLabel();
-    if(getWeight() != nullptr) tmpLabel += (tmpLabel.empty() ? "" : " ") + string("w: ") + to_string(int(*getWeight()));
-    if(getFlow  () != nullptr) tmpLabel += (tmpLabel.empty() ? "" : " ") + string("f: ") + to_string(int(*getFlow  ()));
-    text.setString(tmpLabel);
-    FloatRect bounds = text.getLocalBounds();
-    text.setPosition((u->getPosition() + v->getPosition())/2.0f - Vector2f(bounds.width/2.0f, 0.8f*bounds.height));
+    if(hasWeight) tmpLabel += (tmpLabel.empty() ? "" : " ") + string("w: ") + to_string(int(weight));
+    if(hasFlow  ) tmpLabel += (tmpLabel.empty() ? "" : " ") + string("f: ") + to_string(int(flow  ));
+    text->setString(tmpLabel);
+    text->setCharacterSize(labelSize);
+    text->setFillColor(labelColor);
+    FloatRect bounds = text->getLocalBounds();
+    text->setPosition((u->getPosition() + v->getPosition())/2.0f - Vector2f(bounds.width/2.0f, 0.8f*bounds.height));
+}
+
+void GraphViewer::Edge::updateGraph(){
+    graph->labelSizes.set(lodLabelSize, (text != nullptr ? float(labelSize) : 0.0f));
+    if(shape == nullptr){
+        graph->edgeThicknesses.set(lodThickness, 0.0f);
+        updateZip();
+        if(graph->viewportCulling) graph->edgeGrid.remove(this);
+        return;
+    }
+
+    graph->edgeThicknesses.set(lodThickness, getThickness());
+
+    updateZip();
+    if(graph->zipLabels && (labelZipped || text != nullptr)) graph->edgeLabelZip.invalidate();
+    if(graph->viewportCulling) graph->edgeGrid.insert(this, getBounds());
+}
+
+FloatRect GraphViewer::Edge::getBounds() const {
+    FloatRect ret((u->getPosition() + v->getPosition())/2.0f, Vector2f(0, 0));
+    if(shape != nullptr) ret = shape->getBounds();
+    if(text != nullptr){
+        FloatRect t;
+        if(!textDirty){
+            t = text->getGlobalBounds();
+        } else {
+            // Laying out the text on every move is slow, so bound it from
+            // the number of characters; glyphs are at most labelSize wide
+            // and the text is centered on the edge midpoint
+            size_t chars = label.size() + (hasWeight ? 16 : 0) + (hasFlow ? 16 : 0);
+            Vector2f mid = (u->getPosition() + v->getPosition())/2.0f;
+            float halfWidth = float(chars)*float(labelSize)/2.0f;
+            t = FloatRect(mid.x - halfWidth, mid.y - float(labelSize), 2.0f*halfWidth, 2.0f*float(labelSize));
+        }
+        float left   = min(ret.left, t.left);
+        float top    = min(ret.top , t.top );
+        float right  = max(ret.left+ret.width , t.left+t.width );
+        float bottom = max(ret.top +ret.height, t.top +t.height);
+        ret = FloatRect(left, top, right-left, bottom-top);
+    }
+    return ret;
+}
+
+void GraphViewer::Edge::invalidate(){
+    graph->requestRedraw();
+    if(!graph->deferredUpdates){
+        update();
+        return;
+    }
+    if(!dirty){
+        dirty = true;
+        graph->dirtyEdges.push_back(id);
+    }
+}
+
+void GraphViewer::Edge::updateZip(){
+    if(zip == nullptr) return;
+    // Textured dashes are drawn with another texture, so they have a zip of their own
+    ZipEdges *target = (getDashed() && graph->texturedDashes ? &graph->dashZip : &graph->zip);
+    if(zip != target){
+        zip->release(zipSlot);
+        zip = target;
+    }
+    zip->write(zipSlot, (isEnabled() ? shape : nullptr));
 }
 
 void GraphViewer::Edge::enable() {
     enabled = true;
+    graph->requestRedraw();
+    updateZip();
+    if(graph->zipLabels && text != nullptr) graph->edgeLabelZip.invalidate();
 }
 
 void GraphViewer::Edge::disable() {
     enabled = false;
+    graph->requestRedraw();
+    updateZip();
+    if(labelZipped) graph->edgeLabelZip.invalidate();
 }
 
 bool GraphViewer::Edge::isEnabled() const {
@@ -0,0 +1,383 @@
+#include "forcelayout.h"
+#include "workerpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+using namespace sf;
+
+ForceLayout::ForceLayout(GraphViewer &graph):
+    graph(graph)
+{}
+
+ForceLayout::~ForceLayout(){
+    cancel();
+    if(worker.joinable()) worker.join();
+}
+
+void ForceLayout::setIterations          (unsigned n      ){ iterations           = n;       }
+void ForceLayout::setRefinementIterations(unsigned n      ){ refinementIterations = n;       }
+void ForceLayout::setEdgeLength          (float length    ){ edgeLength           = length;  }
+void ForceLayout::setTheta               (float theta     ){ this->theta          = theta;   }
+void ForceLayout::setGravity             (float gravity   ){ this->gravity        = gravity; }
+void ForceLayout::setThreads             (unsigned threads){ this->threads        = threads; }
+void ForceLayout::setUpdateInterval      (unsigned n      ){ updateInterval       = n;       }
+
+bool     ForceLayout::isRunning   () const { return running;   }
+unsigned ForceLayout::getIteration() const { return iteration; }
+
+void ForceLayout::start(){
+    if(running) throw logic_error("Layout is already running");
+    if(worker.joinable()) worker.join();
+    Parameters p = {iterations, refinementIterations, edgeLength, theta, gravity, threads, updateInterval};
+    if(p.threads == 0) p.threads = max(1u, thread::hardware_concurrency());
+    load();
+    cancelled = false;
+    iteration = 0;
+    exception = nullptr;
+    running = true;
+    worker = thread(&ForceLayout::work, this, p);
+}
+
+void ForceLayout::cancel(){
+    cancelled = true;
+}
+
+void ForceLayout::join(){
+    if(worker.joinable()) worker.join();
+    if(exception){
+        exception_ptr e = exception;
+        exception = nullptr;
+        rethrow_exception(e);
+    }
+}
+
+void ForceLayout::run(){
+    start();
+    join();
+}
+
+void ForceLayout::load(){
+    graph.lock();
+    vector<GraphViewer::Node*> nodes = graph.getNodes();
+    vector<GraphViewer::Edge*> edges = graph.getEdges();
+
+    const size_t N = nodes.size();
+    ids.resize(N);
+    positions.resize(N);
+    unordered_map<GraphViewer::id_t, uint32_t> index;
+    index.reserve(N);
+    for(size_t i = 0; i < N; ++i){
+        ids[i] = nodes[i]->getId();
+        positions[i] = nodes[i]->getPosition();
+        index[ids[i]] = uint32_t(i);
+    }
+    vector<pair<uint32_t, uint32_t>> ends;
+    ends.reserve(edges.size());
+    for(const GraphViewer::Edge *edge: edges){
+        uint32_t u = index.at(edge->getFrom()->getId());
+        uint32_t v = index.at(edge->getTo  ()->getId());
+        if(u != v) ends.emplace_back(min(u, v), max(u, v));
+    }
+    graph.unlock();
+
+    levels.assign(1, Level());
+    makeAdjacency(levels[0], N, ends);
+    currentLevel = 0;
+    ancestors.clear();
+}
+
+void ForceLayout::makeAdjacency(Level &level, size_t n, vector<pair<uint32_t, uint32_t>> &ends){
+    sort(ends.begin(), ends.end());
+    ends.erase(unique(ends.begin(), ends.end()), ends.end());
+    level.adjacencyBegin.assign(n+1, 0);
+    for(const auto &e: ends){
+        ++level.adjacencyBegin[e.first +1];
+        ++level.adjacencyBegin[e.second+1];
+    }
+    for(size_t i = 0; i < n; ++i)
+        level.adjacencyBegin[i+1] += level.adjacencyBegin[i];
+    level.adjacency.resize(level.adjacencyBegin[n]);
+    vector<uint32_t> next(level.adjacencyBegin.begin(), level.adjacencyBegin.end()-1);
+    for(const auto &e: ends){
+        level.adjacency[next[e.first ]++] = e.second;
+        level.adjacency[next[e.second]++] = e.first;
+    }
+}
+
+bool ForceLayout::coarsen(mt19937 &rng){
+    Level &fine = levels.back();
+    const size_t n = fine.size();
+    const uint32_t NONE = numeric_limits<uint32_t>::max();
+
+    // Match each node with its unmatched neighbour of least degree
+    vector<uint32_t> visit(n);
+    iota(visit.begin(), visit.end(), 0);
+    shuffle(visit.begin(), visit.end(), rng);
+    fine.parent.assign(n, NONE);
+    uint32_t m = 0;
+    for(uint32_t u: visit){
+        if(fine.parent[u] != NONE) continue;
+        uint32_t best = NONE, bestDegree = NONE;
+        for(uint32_t a = fine.adjacencyBegin[u]; a < fine.adjacencyBegin[u+1]; ++a){
+            uint32_t v = fine.adjacency[a];
+            uint32_t degree = fine.adjacencyBegin[v+1] - fine.adjacencyBegin[v];
+            if(fine.parent[v] == NONE && degree < bestDegree){
+                best = v;
+                bestDegree = degree;
+            }
+        }
+        fine.parent[u] = m;
+        if(best != NONE) fine.parent[best] = m;
+        ++m;
+    }
+    if(m > COARSENING_RATIO*float(n)){
+        fine.parent.clear();
+        return false;
+    }
+
+    vector<pair<uint32_t, uint32_t>> ends;
+    ends.reserve(fine.adjacency.size()/2);
+    for(uint32_t u = 0; u < n; ++u){
+        for(uint32_t a = fine.adjacencyBegin[u]; a < fine.adjacencyBegin[u+1]; ++a){
+            uint32_t cu = fine.parent[u], cv = fine.parent[fine.adjacency[a]];
+            if(cu < cv) ends.emplace_back(cu, cv);
+        }
+    }
+    Level coarse;
+    makeAdjacency(coarse, m, ends);
+    levels.push_back(move(coarse));
+    return true;
+}
+
+void ForceLayout::work(Parameters p){
+    try {
+        const size_t N = positions.size();
+        const float k = p.edgeLength;
+        mt19937 rng(RANDOM_SEED);
+
+        // If nodes already have a meaningful layout, refine it; otherwise,
+        // coarsen the graph, lay out the coarsest graph from random
+        // positions, and then lay out each finer graph starting from the
+        // positions of the nodes it was collapsed into
+        Vector2f lo, hi;
+        bounds(lo, hi);
+        bool refine = (N <= 1 || max(hi.x-lo.x, hi.y-lo.y) >= k);
+        if(!refine)
+            while(levels.back().size() > COARSEST_SIZE && !cancelled && coarsen(rng)) {}
+
+        for(size_t l = levels.size(); l-- > 0 && !cancelled && N > 0; ){
+            currentLevel = l;
+            const size_t n = levels[l].size();
+            if(l+1 == levels.size()){
+                if(refine){
+                    uniform_real_distribution<float> d(-1e-3f*k, 1e-3f*k);
+                    for(Vector2f &pos: positions) pos += Vector2f(d(rng), d(rng));
+                } else {
+                    uniform_real_distribution<float> d(0, k*sqrt(float(n)));
+                    positions.resize(n);
+                    for(Vector2f &pos: positions) pos = lo + Vector2f(d(rng), d(rng));
+                }
+            } else {
+                // Finer graphs have more nodes, so they need more space
+                uniform_real_distribution<float> d(-0.1f*k, 0.1f*k);
+                const float expansion = sqrt(float(n)/float(positions.size()));
+                vector<Vector2f> finePositions(n);
+                for(size_t i = 0; i < n; ++i)
+                    finePositions[i] = positions[levels[l].parent[i]]*expansion + Vector2f(d(rng), d(rng));
+                positions.swap(finePositions);
+            }
+
+            ancestors.resize(N);
+            iota(ancestors.begin(), ancestors.end(), 0);
+            for(size_t m = 0; m < l; ++m)
+                for(uint32_t &a: ancestors) a = levels[m].parent[a];
+
+            forces.assign(n, Vector2f(0, 0));
+            order.resize(n);
+            iota(order.begin(), order.end(), 0);
+            cells.clear();
+            cells.reserve(2*n/LEAF_SIZE + 1);
+
+            // Adaptive step length (Hu, 2005): grows while the energy of the
+            // system keeps decreasing, and shrinks when it does not
+            float step = (refine || l+1 < levels.size() ? FINE_STEP*k : k*max(1.0f, 0.1f*sqrt(float(n))));
+            float energy = numeric_limits<float>::infinity();
+            unsigned progress = 0;
+            const unsigned maxIterations = (l+1 < levels.size() ? p.refinementIterations : p.iterations);
+            for(unsigned it = 0; it < maxIterations && !cancelled && step >= MIN_STEP*k; ++it){
+                buildTree();
+
+                WorkerPool::getInstance().parallelFor(n, [this, &p](size_t begin, size_t end){
+                    computeForces(uint32_t(begin), uint32_t(end), p);
+                }, p.threads);
+
+                float newEnergy = 0;
+                for(size_t i = 0; i < n; ++i){
+                    Vector2f f = forces[i];
+                    float f2 = f.x*f.x + f.y*f.y;
+                    newEnergy += f2;
+                    if(f2 > 0) positions[i] += f*(step/sqrt(f2));
+                }
+                if(newEnergy < energy){
+                    if(++progress >= 5){
+                        progress = 0;
+                        step /= STEP_FACTOR;
+                    }
+                } else {
+                    progress = 0;
+                    step *= STEP_FACTOR;
+                }
+                energy = newEnergy;
+
+                ++iteration;
+                if(p.updateInterval > 0 && iteration % p.updateInterval == 0)
+                    commit(p);
+            }
+        }
+        commit(p);
+    } catch(...){
+        exception = current_exception();
+    }
+    running = false;
+}
+
+void ForceLayout::bounds(Vector2f &lo, Vector2f &hi) const {
+    lo = hi = (positions.empty() ? Vector2f(0, 0) : positions[0]);
+    for(const Vector2f &p: positions){
+        lo.x = min(lo.x, p.x); lo.y = min(lo.y, p.y);
+        hi.x = max(hi.x, p.x); hi.y = max(hi.y, p.y);
+    }
+}
+
+void ForceLayout::buildTree(){
+    // Order is kept from the previous iteration, where it is mostly sorted
+    const size_t N = positions.size();
+    Vector2f lo, hi;
+    bounds(lo, hi);
+    float size = max(max(hi.x-lo.x, hi.y-lo.y), 1.0f)*1.001f;
+
+    cells.clear();
+    buildCell(0, uint32_t(N), lo, size, 0);
+}
+
+int32_t ForceLayout::buildCell(uint32_t begin, uint32_t end, const Vector2f &origin, float size, int depth){
+    int32_t c = int32_t(cells.size());
+    cells.emplace_back();
+    cells[c].origin = origin;
+    cells[c].size = size;
+    cells[c].begin = begin;
+    cells[c].end = end;
+    fill(cells[c].children, cells[c].children+4, -1);
+
+    Vector2f sum(0, 0);
+    if(end - begin <= LEAF_SIZE || depth == MAX_DEPTH){
+        for(uint32_t i = begin; i < end; ++i)
+            sum += positions[order[i]];
+    } else {
+        const float half = size/2;
+        const Vector2f mid = origin + Vector2f(half, half);
+        const vector<Vector2f> &pos = positions;
+        uint32_t *o = order.data();
+        uint32_t *my = partition(o+begin, o+end, [&pos, &mid](uint32_t i){ return pos[i].y < mid.y; });
+        uint32_t *mx0 = partition(o+begin, my , [&pos, &mid](uint32_t i){ return pos[i].x < mid.x; });
+        uint32_t *mx1 = partition(my     , o+end, [&pos, &mid](uint32_t i){ return pos[i].x < mid.x; });
+        const uint32_t bounds[5] = {begin, uint32_t(mx0-o), uint32_t(my-o), uint32_t(mx1-o), end};
+        const Vector2f origins[4] = {origin, origin + Vector2f(half, 0), origin + Vector2f(0, half), mid};
+        for(int q = 0; q < 4; ++q){
+            if(bounds[q] == bounds[q+1]) continue;
+            int32_t child = buildCell(bounds[q], bounds[q+1], origins[q], half, depth+1);
+            cells[c].children[q] = child;
+            sum += cells[child].center*cells[child].mass;
+        }
+    }
+    cells[c].mass = float(end - begin);
+    cells[c].center = sum/cells[c].mass;
+    return c;
+}
+
+void ForceLayout::computeForces(uint32_t begin, uint32_t end, const Parameters &p){
+    const float k = p.edgeLength;
+    const float k2 = REPULSION*k*k;
+    const float theta2 = p.theta*p.theta;
+    const float minDist2 = 1e-4f*k2;
+    const Vector2f center = cells[0].center;
+    const Level &level = levels[currentLevel];
+
+    vector<int32_t> stack;
+    stack.reserve(4*MAX_DEPTH);
+    for(uint32_t oi = begin; oi < end; ++oi){
+        const uint32_t i = order[oi];
+        const Vector2f pi = positions[i];
+        Vector2f f(0, 0);
+
+        // Repulsion: C*k^2/d, away from each other node
+        stack.push_back(0);
+        while(!stack.empty()){
+            const Cell &cell = cells[stack.back()];
+            stack.pop_back();
+            if(cell.children[0] < 0 && cell.children[1] < 0 && cell.children[2] < 0 && cell.children[3] < 0){
+                for(uint32_t oj = cell.begin; oj < cell.end; ++oj){
+                    const uint32_t j = order[oj];
+                    if(j == i) continue;
+                    Vector2f d = pi - positions[j];
+                    float d2 = max(d.x*d.x + d.y*d.y, minDist2);
+                    f += d*(k2/d2);
+                }
+                continue;
+            }
+            Vector2f d = pi - cell.center;
+            float d2 = max(d.x*d.x + d.y*d.y, minDist2);
+            bool inside = (cell.origin.x <= pi.x && pi.x <= cell.origin.x + cell.size &&
+                           cell.origin.y <= pi.y && pi.y <= cell.origin.y + cell.size);
+            if(!inside && cell.size*cell.size < theta2*d2){
+                f += d*(k2*cell.mass/d2);
+            } else {
+                for(int q = 0; q < 4; ++q)
+                    if(cell.children[q] >= 0) stack.push_back(cell.children[q]);
+            }
+        }
+
+        // Attraction: d^2/k, towards each neighbour
+        for(uint32_t a = level.adjacencyBegin[i]; a < level.adjacencyBegin[i+1]; ++a){
+            Vector2f d = positions[level.adjacency[a]] - pi;
+            float dist = sqrt(d.x*d.x + d.y*d.y);
+            f += d*(dist/k);
+        }
+
+        // Gravity: towards the center of all nodes
+        f += (center - pi)*p.gravity;
+
+        forces[i] = f;
+    }
+}
+
+void ForceLayout::commit(const Parameters &p){
+    // Forces only determine the layout up to scale; scale it so the average
+    // edge has the ideal length
+    if(ancestors.empty()) return;
+    const Level &level = levels[currentLevel];
+    float length = 0;
+    for(uint32_t i = 0; i < level.size(); ++i){
+        for(uint32_t a = level.adjacencyBegin[i]; a < level.adjacencyBegin[i+1]; ++a){
+            Vector2f d = positions[level.adjacency[a]] - positions[i];
+            length += sqrt(d.x*d.x + d.y*d.y);
+        }
+    }
+    float scale = (length > 0 ? p.edgeLength*float(level.adjacency.size())/length : 1.0f);
+    Vector2f lo, hi;
+    bounds(lo, hi);
+    Vector2f center = (lo + hi)/2.0f;
+
+    vector<Vector2f> scaled(ancestors.size());
+    for(size_t i = 0; i < ancestors.size(); ++i)
+        scaled[i] = center + (positions[ancestors[i]] - center)*scale;
+    graph.setPositions(ids, scaled);
+}
@@ -1,5 +1,15 @@
 #include "fpsmonitor.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/// Upper limits of histogram buckets, in milliseconds: 240, 120, 60, 30, 20,
+/// 10 and 5 FPS.
+static const float HISTOGRAM_LIMITS[FPSMonitor::HISTOGRAM_BUCKETS-1] = {
+    1000.0f/240, 1000.0f/120, 1000.0f/60, 1000.0f/30, 1000.0f/20, 1000.0f/10, 1000.0f/5
+};
+
 FPSMonitor::FPSMonitor(int ms):
     Dt(std::chrono::milliseconds(ms))
 {
@@ -9,14 +19,68 @@ void FPSMonitor::setInterval(int ms){
     Dt = std::chrono::milliseconds(ms);
 }
 
-void FPSMonitor::count(){
-    auto now = std::chrono::high_resolution_clock::now();
-    q.push(now);
-    while(now-q.front() > Dt){
-        q.pop();
+const FPSMonitor::clock::time_point& FPSMonitor::at(size_t i) const{
+    return q[(head + i) % CAPACITY];
+}
+
+size_t FPSMonitor::expired(clock::time_point now) const{
+    size_t i = 0;
+    while(i < size && now-at(i) > Dt) ++i;
+    return i;
+}
+
+void FPSMonitor::count(float frameTime){
+    auto now = clock::now();
+    if(size == CAPACITY){
+        head = (head + 1) % CAPACITY;
+        --size;
+    }
+    q[(head + size) % CAPACITY] = now;
+    frameTimes[(head + size) % CAPACITY] = frameTime;
+    ++size;
+    while(now-at(0) > Dt){
+        head = (head + 1) % CAPACITY;
+        --size;
     }
 }
 
 float FPSMonitor::getFPS() const{
-    return float(q.size())/(float(std::chrono::duration_cast<std::chrono::milliseconds>(Dt).count())/1000.0f);
+    size_t n = size - expired(clock::now());
+    return float(n)/(float(std::chrono::duration_cast<std::chrono::milliseconds>(Dt).count())/1000.0f);
+}
+
+FPSMonitor::Statistics FPSMonitor::getStatistics() const{
+    Statistics ret;
+    const size_t first = expired(clock::now());
+    const size_t n = size - first;
+    if(n == 0) return ret;
+
+    std::array<float, CAPACITY> times;
+    double sum = 0.0;
+    for(size_t i = 0; i < n; ++i){
+        times[i] = frameTimes[(head + first + i) % CAPACITY];
+        sum += times[i];
+        size_t bucket = size_t(std::upper_bound(HISTOGRAM_LIMITS, HISTOGRAM_LIMITS + HISTOGRAM_BUCKETS-1, times[i]) - HISTOGRAM_LIMITS);
+        ++ret.histogram[bucket];
+    }
+    std::sort(times.begin(), times.begin() + n);
+
+    // Nearest-rank percentiles
+    auto percentile = [&times, n](float p){
+        size_t rank = size_t(std::ceil(p*float(n)));
+        return times[std::max(rank, size_t(1)) - 1];
+    };
+    ret.frames = n;
+    ret.min = times[0];
+    ret.avg = float(sum/double(n));
+    ret.p50 = percentile(0.50f);
+    ret.p95 = percentile(0.95f);
+    ret.p99 = percentile(0.99f);
+    ret.max = times[n-1];
+    return ret;
+}
+
+float FPSMonitor::getHistogramLimit(size_t i){
+    if(i+1 >= HISTOGRAM_BUCKETS) return std::numeric_limits<float>::infinity();
+    return HISTOGRAM_LIMITS[i];
 }
@@ -1,6 +1,11 @@
 #include "graphviewer.h"
+#include "renderscheduler.h"
+#include "workerpool.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
 #include <iostream>
 
 using namespace std;
@@ -36,12 +41,296 @@ const GraphViewer::Color GraphViewer::GRAY  (128, 128, 128);
 const GraphViewer::Color GraphViewer::LIGHT_GRAY(192, 192, 192);
 const GraphViewer::Color GraphViewer::DARK_GRAY(64, 64, 64);
 
-void GraphViewer::ZipEdges::append(const VertexArray &a){
-    for(size_t i = 0; i < a.getVertexCount(); ++i){
-        vertices.push_back(a[i]);
+/// Vertex that is not drawn; used to fill unused parts of the zipped edges.
+static const Vertex EMPTY_VERTEX(Vector2f(0, 0), Color::Transparent);
+
+typedef chrono::steady_clock SteadyClock;
+
+/// Milliseconds elapsed since a time point.
+static float millisecondsSince(const SteadyClock::time_point &t){
+    return chrono::duration<float, milli>(SteadyClock::now() - t).count();
+}
+
+/// Draw vertices, and count them in the frame statistics.
+static void drawVertices(RenderTarget &target, const Vertex *vertices, size_t n, PrimitiveType type, GraphViewer::FrameStats &stats, const RenderStates &states = RenderStates::Default){
+    target.draw(vertices, n, type, states);
+    ++stats.drawCalls;
+    stats.vertices += n;
+}
+
+/// Draw a drawable, and count it in the frame statistics.
+static void drawCounted(RenderTarget &target, const Drawable &drawable, size_t vertices, GraphViewer::FrameStats &stats, const RenderStates &states = RenderStates::Default){
+    target.draw(drawable, states);
+    ++stats.drawCalls;
+    stats.vertices += vertices;
+}
+
+/// Draw a shape; its fill is a triangle fan, and its outline a triangle strip.
+static void drawCounted(RenderTarget &target, const Shape &shape, GraphViewer::FrameStats &stats){
+    size_t n = shape.getPointCount();
+    drawCounted(target, shape, (n+2) + (shape.getOutlineThickness() != 0.0f ? 2*(n+1) : 0), stats);
+}
+
+/// Draw a text; each glyph is two triangles.
+static void drawCounted(RenderTarget &target, const Text &text, GraphViewer::FrameStats &stats){
+    drawCounted(target, text, 6*text.getString().getSize(), stats);
+}
+
+GraphViewer::ZipEdges::Slot GraphViewer::ZipEdges::allocate(size_t length){
+    Slot slot;
+    slot.length = length;
+    auto it = freeSlots.find(length);
+    if(it != freeSlots.end() && !it->second.empty()){
+        slot.offset = it->second.back();
+        it->second.pop_back();
+        freeVertices -= length;
+    } else {
+        slot.offset = vertices.size();
+        vertices.resize(vertices.size() + length, EMPTY_VERTEX);
     }
+    return slot;
 }
+
+void GraphViewer::ZipEdges::write(Slot &slot, const VertexArray *a){
+    ++version;
+    size_t n = (a == nullptr ? 0 : a->getVertexCount());
+    if(n == 0){
+        release(slot);
+        return;
+    }
+    if(n > slot.length){
+        release(slot);
+        slot = allocate(n);
+    }
+    for(size_t i = 0; i < n; ++i)
+        vertices[slot.offset+i] = (*a)[i];
+    fill(vertices.begin()+long(slot.offset+n), vertices.begin()+long(slot.offset+slot.length), EMPTY_VERTEX);
+}
+
+void GraphViewer::ZipEdges::release(Slot &slot){
+    if(slot.length == 0) return;
+    ++version;
+    fill(vertices.begin()+long(slot.offset), vertices.begin()+long(slot.offset+slot.length), EMPTY_VERTEX);
+    freeSlots[slot.length].push_back(slot.offset);
+    freeVertices += slot.length;
+    slot = Slot();
+}
+
+bool GraphViewer::ZipEdges::isFragmented() const{
+    return freeVertices > 1024 && 2*freeVertices > vertices.size();
+}
+
+void GraphViewer::ZipEdges::clear(){
+    ++version;
+    vertices.clear();
+    freeSlots.clear();
+    freeVertices = 0;
+}
+
 const vector<Vertex>& GraphViewer::ZipEdges::getVertices() const{ return vertices; }
+unsigned long GraphViewer::ZipEdges::getVersion() const{ return version; }
+
+void GraphViewer::MaxSize::set(float &recorded, float size){
+    if(size == recorded) return;
+    if(recorded > 0.0f){
+        auto it = counts.find(recorded);
+        if(it != counts.end() && --it->second == 0) counts.erase(it);
+    }
+    if(size > 0.0f) ++counts[size];
+    else size = 0.0f;
+    recorded = size;
+}
+
+float GraphViewer::MaxSize::get() const{
+    return (counts.empty() ? 0.0f : counts.rbegin()->first);
+}
+
+void GraphViewer::MaxSize::clear(){
+    counts.clear();
+}
+
+void GraphViewer::ZipLabels::invalidate(){ dirty = true; }
+bool GraphViewer::ZipLabels::isDirty() const{ return dirty; }
+void GraphViewer::ZipLabels::validate(){ dirty = false; }
+size_t GraphViewer::ZipLabels::getVertexCount() const{ return vertexCount; }
+
+void GraphViewer::ZipLabels::clear(){
+    for(auto &p: pages) p.second.clear();
+    vertexCount = 0;
+}
+
+void GraphViewer::ZipLabels::append(const Text &text){
+    const Font *font = text.getFont();
+    if(font == nullptr) return;
+    const String &str = text.getString();
+    const unsigned size = text.getCharacterSize();
+    const bool bold = (text.getStyle() & Text::Bold) != 0;
+    const Color &color = text.getFillColor();
+    const Transform &transform = text.getTransform();
+    vector<Vertex> &vertices = pages[PageKey(font, size)];
+    const size_t initialSize = vertices.size();
+
+    // Same layout as sf::Text, but with one quad per glyph
+    const float whitespaceWidth = font->getGlyph(L' ', size, bold).advance;
+    const float lineSpacing = font->getLineSpacing(size);
+    const float padding = 1.0f;
+    float x = 0.0f;
+    float y = float(size);
+    Uint32 prevChar = 0;
+    for(size_t i = 0; i < str.getSize(); ++i){
+        Uint32 curChar = str[i];
+        x += font->getKerning(prevChar, curChar, size);
+        prevChar = curChar;
+        switch(curChar){
+            case L' ' : x += whitespaceWidth; continue;
+            case L'\t': x += whitespaceWidth*4; continue;
+            case L'\n': y += lineSpacing; x = 0; continue;
+            default: break;
+        }
+        const Glyph &glyph = font->getGlyph(curChar, size, bold);
+        float left   = glyph.bounds.left - padding;
+        float top    = glyph.bounds.top  - padding;
+        float right  = glyph.bounds.left + glyph.bounds.width  + padding;
+        float bottom = glyph.bounds.top  + glyph.bounds.height + padding;
+        float u1 = float(glyph.textureRect.left) - padding;
+        float v1 = float(glyph.textureRect.top ) - padding;
+        float u2 = float(glyph.textureRect.left + glyph.textureRect.width ) + padding;
+        float v2 = float(glyph.textureRect.top  + glyph.textureRect.height) + padding;
+        vertices.push_back(Vertex(transform.transformPoint(Vector2f(x+left , y+top   )), color, Vector2f(u1, v1)));
+        vertices.push_back(Vertex(transform.transformPoint(Vector2f(x+right, y+top   )), color, Vector2f(u2, v1)));
+        vertices.push_back(Vertex(transform.transformPoint(Vector2f(x+right, y+bottom)), color, Vector2f(u2, v2)));
+        vertices.push_back(Vertex(transform.transformPoint(Vector2f(x+left , y+bottom)), color, Vector2f(u1, v2)));
+        x += glyph.advance;
+    }
+    vertexCount += vertices.size() - initialSize;
+}
+
+void GraphViewer::ZipLabels::draw(RenderTarget &target, FrameStats &stats) const{
+    for(const auto &p: pages){
+        const vector<Vertex> &v = p.second;
+        if(v.empty()) continue;
+        const Texture &texture = p.first.first->getTexture(p.first.second);
+        drawVertices(target, &v[0], v.size(), Quads, stats, RenderStates(&texture));
+    }
+}
+
+GraphViewer::ZipNodes::~ZipNodes(){
+    delete disc;
+}
+
+GraphViewer::ZipNodes::Batch& GraphViewer::ZipNodes::getBatch(const Texture *texture){
+    if(texture == nullptr) return circles;
+    return icons[texture];
+}
+
+void GraphViewer::ZipNodes::write(Slot &slot, const Node *node){
+    if(node == nullptr || !node->isEnabled() || node->getShape() == nullptr){
+        release(slot);
+        return;
+    }
+    const Texture *texture = (node->getIsIcon() ? &node->getIcon() : nullptr);
+    size_t stride = (texture == nullptr ? 8 : 4);
+    if(slot.used && slot.texture != texture) release(slot);
+    Batch &batch = getBatch(texture);
+    if(!slot.used){
+        slot.texture = texture;
+        slot.used = true;
+        if(!batch.freeOffsets.empty()){
+            slot.offset = batch.freeOffsets.back();
+            batch.freeOffsets.pop_back();
+        } else {
+            slot.offset = batch.vertices.size();
+            batch.vertices.resize(batch.vertices.size() + stride, EMPTY_VERTEX);
+        }
+        ++batch.count;
+    }
+
+    Vertex *v = &batch.vertices[slot.offset];
+    const Vector2f &pos = node->getPosition();
+    if(texture == nullptr){
+        writeCircle(*node, v);
+    } else {
+        FloatRect t(node->getIconRect());
+        float r = node->getSize()/2.0f;
+        v[0] = Vertex(pos + Vector2f(-r, -r), Color::White, Vector2f(t.left        , t.top         ));
+        v[1] = Vertex(pos + Vector2f(+r, -r), Color::White, Vector2f(t.left+t.width, t.top         ));
+        v[2] = Vertex(pos + Vector2f(+r, +r), Color::White, Vector2f(t.left+t.width, t.top+t.height));
+        v[3] = Vertex(pos + Vector2f(-r, +r), Color::White, Vector2f(t.left        , t.top+t.height));
+    }
+}
+
+void GraphViewer::ZipNodes::release(Slot &slot){
+    if(!slot.used) return;
+    Batch &batch = getBatch(slot.texture);
+    size_t stride = (slot.texture == nullptr ? 8 : 4);
+    fill(batch.vertices.begin()+long(slot.offset), batch.vertices.begin()+long(slot.offset+stride), EMPTY_VERTEX);
+    batch.freeOffsets.push_back(slot.offset);
+    --batch.count;
+    if(batch.count == 0){
+        if(slot.texture == nullptr) circles = Batch();
+        else icons.erase(slot.texture);
+    }
+    slot = Slot();
+}
+
+void GraphViewer::ZipNodes::clear(){
+    circles = Batch();
+    icons.clear();
+}
+
+void GraphViewer::ZipNodes::writeCircle(const Node &node, Vertex *v){
+    const float d = float(DISC_SIZE);
+    const Vector2f &pos = node.getPosition();
+    float r = node.getSize()/2.0f;
+    float R = r + max(node.getOutlineThickness(), 0.0f);
+    Color outlineColor = (R > r ? node.getOutlineColor() : Color::Transparent);
+    v[0] = Vertex(pos + Vector2f(-R, -R), outlineColor, Vector2f(0, 0));
+    v[1] = Vertex(pos + Vector2f(+R, -R), outlineColor, Vector2f(d, 0));
+    v[2] = Vertex(pos + Vector2f(+R, +R), outlineColor, Vector2f(d, d));
+    v[3] = Vertex(pos + Vector2f(-R, +R), outlineColor, Vector2f(0, d));
+    v[4] = Vertex(pos + Vector2f(-r, -r), node.getColor(), Vector2f(0, 0));
+    v[5] = Vertex(pos + Vector2f(+r, -r), node.getColor(), Vector2f(d, 0));
+    v[6] = Vertex(pos + Vector2f(+r, +r), node.getColor(), Vector2f(d, d));
+    v[7] = Vertex(pos + Vector2f(-r, +r), node.getColor(), Vector2f(0, d));
+}
+
+const Texture& GraphViewer::ZipNodes::getDisc(){
+    if(disc == nullptr){
+        // Disc with antialiased border, tinted by the vertex colors
+        Image image;
+        image.create(DISC_SIZE, DISC_SIZE, Color::Transparent);
+        const float c = float(DISC_SIZE)/2.0f;
+        for(unsigned x = 0; x < DISC_SIZE; ++x){
+            for(unsigned y = 0; y < DISC_SIZE; ++y){
+                float dx = float(x)+0.5f-c, dy = float(y)+0.5f-c;
+                float alpha = min(max(c - sqrt(dx*dx + dy*dy), 0.0f), 1.0f);
+                image.setPixel(x, y, Color(255, 255, 255, Uint8(alpha*255.0f)));
+            }
+        }
+        disc = new Texture();
+        disc->loadFromImage(image);
+        disc->setSmooth(true);
+        disc->generateMipmap();
+    }
+    return *disc;
+}
+
+void GraphViewer::ZipNodes::drawCircles(RenderTarget &target, FrameStats &stats){
+    if(circles.vertices.empty()) return;
+    drawVertices(target, &circles.vertices[0], circles.vertices.size(), Quads, stats, RenderStates(&getDisc()));
+}
+
+void GraphViewer::ZipNodes::drawIcons(RenderTarget &target, FrameStats &stats){
+    for(const auto &p: icons){
+        const vector<Vertex> &v = p.second.vertices;
+        drawVertices(target, &v[0], v.size(), Quads, stats, RenderStates(p.first));
+    }
+}
+
+void GraphViewer::ZipNodes::draw(RenderTarget &target, FrameStats &stats){
+    drawCircles(target, stats);
+    drawIcons(target, stats);
+}
 
 string getPath(const string &filename){
     const size_t last_slash_idx = min(filename.rfind('\\'), filename.rfind('/'));
@@ -69,6 +358,11 @@ GraphViewer::GraphViewer():
     debug_text.setStyle(Text::Bold);
 }
 
+GraphViewer::~GraphViewer(){
+    if(scheduler != nullptr) scheduler->remove(this);
+    delete offscreen;
+}
+
 void GraphViewer::createWindow(unsigned int width, unsigned int height){
     if(window != nullptr) throw runtime_error("Window was already created");
     if(width  == 0) width  = DEFAULT_WIDTH ;
@@ -77,9 +371,10 @@ void GraphViewer::createWindow(unsigned int width, unsigned int height){
     this->height = height;
 
 #ifndef WORKER_THREAD_CANT_HANDLE
-    main_thread = new thread(&GraphViewer::run, this);
+    if(scheduler != nullptr) scheduler->add(this);
+    else main_thread = new thread(&GraphViewer::run, this);
     unique_lock<mutex> lock(isWindowOpenCVMutex);
-    isWindowOpenCV.wait(lock);
+    isWindowOpenCV.wait(lock, [this]{ return windowOpen.load(); });
 #else
     GraphViewer::run();
 #endif
@@ -87,6 +382,7 @@ void GraphViewer::createWindow(unsigned int width, unsigned int height){
 }
 
 void GraphViewer::closeWindow(){
+    if(scheduler != nullptr) scheduler->remove(this);
     window->close();
     delete window    ; window     = nullptr;
     delete view      ; view       = nullptr;
@@ -97,11 +393,10 @@ void GraphViewer::setCenter(const sf::Vector2f &center){
     {
         lock_guard<mutex> lock(graphMutex);
         this->center = center;
+        if(isWindowOpen()) recalculateView();
     }
-    if(isWindowOpen()){
-        lock_guard<mutex> lock(graphMutex);
-        recalculateView();
-    }
+    // Only after the view changed, so the requested frame draws it
+    requestRedraw();
 }
 
 const sf::Vector2f &GraphViewer::getCenter() const{
@@ -112,11 +407,10 @@ void GraphViewer::setScale(float scale){
     {
         lock_guard<mutex> lock(graphMutex);
         this->scale = scale;
+        if(isWindowOpen()) recalculateView();
     }
-    if(isWindowOpen()){
-        lock_guard<mutex> lock(graphMutex);
-        recalculateView();
-    }
+    // Only after the view changed, so the requested frame draws it
+    requestRedraw();
 }
 
 float GraphViewer::getScale() const {
@@ -125,9 +419,14 @@ float GraphViewer::getScale() const {
 
 GraphViewer::Node& GraphViewer::addNode(id_t id, const sf::Vector2f &position){
     lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
     if(nodes.count(id))
         throw invalid_argument("A node with that ID already exists");
-    return *(nodes[id] = new Node(id, position));
+    Node &ret = *nodePool.create(*this, id, position);
+    nodes.insert(id, &ret);
+    if(zipNodes) ret.zip = &nodeZip;
+    ret.update();
+    return ret;
 }
 
 GraphViewer::Node& GraphViewer::getNode(GraphViewer::id_t id){
@@ -136,30 +435,33 @@ GraphViewer::Node& GraphViewer::getNode(GraphViewer::id_t id){
 
 vector<GraphViewer::Node *> GraphViewer::getNodes() {
     vector<Node*> ret;
-    ret.reserve(nodes.size());
-    for(auto &p: nodes){
-        ret.push_back(p.second);
+    ret.reserve(nodePool.size());
+    for(Node &node: nodePool){
+        ret.push_back(&node);
     }
     return ret;
 }
 
 void GraphViewer::removeNode(GraphViewer::id_t id){
     lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
     Node *node = nodes.at(id);
-    while(!node->edges.empty()){
-        Edge *edge = *node->edges.begin();
-        removeEdge_noLock(edge->getId());
-    }
-    delete node;
+    while(!node->edges.empty())
+        removeEdge_noLock(node->edges.back()->getId());
+    releaseNode(node);
+    nodePool.destroy(node);
     nodes.erase(id);
 }
 
 GraphViewer::Edge& GraphViewer::addEdge(id_t id, Node &u, Node &v, Edge::EdgeType edge_type){
     lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
     if(edges.count(id))
         throw invalid_argument("An edge with that ID already exists");
-    Edge &ret = *(edges[id] = new Edge(id, u, v, edge_type));
-    if(zipEdges) updateZip();
+    Edge &ret = *edgePool.create(id, u, v, edge_type);
+    edges.insert(id, &ret);
+    if(zipEdges) ret.zip = &zip;
+    ret.update();
     return ret;
 }
 
@@ -169,29 +471,248 @@ GraphViewer::Edge &GraphViewer::getEdge(GraphViewer::id_t id) {
 
 vector<GraphViewer::Edge *> GraphViewer::getEdges() {
     vector<Edge*> ret;
-    ret.reserve(edges.size());
-    for(auto &p: edges){
-        ret.push_back(p.second);
+    ret.reserve(edgePool.size());
+    for(Edge &edge: edgePool){
+        ret.push_back(&edge);
     }
     return ret;
 }
 
 void GraphViewer::removeEdge(GraphViewer::id_t id){
     lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
     removeEdge_noLock(id);
 }
 
 void GraphViewer::removeEdge_noLock(GraphViewer::id_t id){
     Edge *edge = edges.at(id);
-    edge->u->edges.erase(edge->u->edges.find(edge));
-    edge->v->edges.erase(edge->v->edges.find(edge));
-    delete edge;
+    edge->detach();
+    releaseEdge(edge);
+    edgePool.destroy(edge);
     edges.erase(id);
-    if(zipEdges) updateZip();
+    if(zipEdges && isZipFragmented()) updateZip();
+}
+
+void GraphViewer::releaseNode(Node *node){
+    ++removals;
+    nodeSizes.set(node->lodSize, 0.0f);
+    labelSizes.set(node->lodLabelSize, 0.0f);
+    if(node->zip != nullptr) node->zip->release(node->zipSlot);
+    nodeGrid.remove(node);
+    if(node->labelZipped) nodeLabelZip.invalidate();
+}
+
+void GraphViewer::releaseEdge(Edge *edge){
+    ++removals;
+    edgeThicknesses.set(edge->lodThickness, 0.0f);
+    labelSizes.set(edge->lodLabelSize, 0.0f);
+    if(edge->zip != nullptr) edge->zip->release(edge->zipSlot);
+    edgeGrid.remove(edge);
+    if(edge->labelZipped) edgeLabelZip.invalidate();
+}
+
+void GraphViewer::addNodes(const vector<NodeDescriptor> &descriptors){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    for(const NodeDescriptor &d: descriptors)
+        if(nodes.count(d.id))
+            throw invalid_argument("A node with that ID already exists");
+
+    nodes.reserve(nodes.size() + descriptors.size());
+    nodePool.reserve(nodePool.size() + descriptors.size());
+    vector<Node*> added;
+    added.reserve(descriptors.size());
+    auto rollback = [this, &added](){
+        for(Node *node: added){
+            nodes.erase(node->getId());
+            nodePool.destroy(node);
+        }
+    };
+    for(const NodeDescriptor &d: descriptors){
+        Node *node = nodePool.create(*this, d.id, d.position);
+        if(!nodes.insert(d.id, node)){
+            nodePool.destroy(node);
+            rollback();
+            throw invalid_argument("A node with that ID already exists");
+        }
+        added.push_back(node);
+        node->color = d.color;
+        node->size  = d.size;
+        if(!d.label.empty()) node->text.setString(d.label);
+        if(!d.icon.empty()){
+            try {
+                node->icon = TextureCache::getInstance().get(d.icon);
+            } catch(...){
+                rollback();
+                throw;
+            }
+            node->isIcon = true;
+            node->iconPath = d.icon;
+        }
+        if(zipNodes) node->zip = &nodeZip;
+    }
+
+    for(Node *node: added)
+        node->update();
+}
+
+void GraphViewer::addEdges(const vector<EdgeDescriptor> &descriptors){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    for(const EdgeDescriptor &d: descriptors){
+        if(edges.count(d.id))
+            throw invalid_argument("An edge with that ID already exists");
+        nodes.at(d.u);
+        nodes.at(d.v);
+    }
+
+    edges.reserve(edges.size() + descriptors.size());
+    edgePool.reserve(edgePool.size() + descriptors.size());
+    vector<Edge*> added;
+    added.reserve(descriptors.size());
+    for(const EdgeDescriptor &d: descriptors){
+        if(edges.count(d.id)){
+            for(Edge *edge: added){
+                edge->detach();
+                edges.erase(edge->getId());
+                edgePool.destroy(edge);
+            }
+            throw invalid_argument("An edge with that ID already exists");
+        }
+        Edge *edge = edgePool.create(d.id, *nodes.get(d.u), *nodes.get(d.v), d.edge_type);
+        edges.insert(d.id, edge);
+        edge->color     = d.color;
+        edge->thickness = d.thickness;
+        edge->label     = d.label;
+        edge->dashed    = d.dashed;
+        edge->hasWeight = d.hasWeight;
+        edge->weight    = d.weight;
+        edge->hasFlow   = d.hasFlow;
+        edge->flow      = d.flow;
+        if(zipEdges) edge->zip = &zip;
+        added.push_back(edge);
+    }
+
+    vector<Edge*> computed;
+    computed.reserve(added.size());
+    for(size_t i = 0; i < added.size(); ++i){
+        const EdgeDescriptor &d = descriptors[i];
+        if(d.geometry == nullptr) computed.push_back(added[i]);
+        else added[i]->setShape(d.geometry, d.geometrySize);
+    }
+    updateEdgeShapes(computed);
+    for(Edge *edge: added){
+        edge->updateText();
+        edge->updateGraph();
+    }
+}
+
+void GraphViewer::addGraph(const vector<NodeDescriptor> &nodeDescriptors, const vector<EdgeDescriptor> &edgeDescriptors){
+    addNodes(nodeDescriptors);
+    auto rollback = [this, &nodeDescriptors](){
+        vector<id_t> ids;
+        ids.reserve(nodeDescriptors.size());
+        for(const NodeDescriptor &d: nodeDescriptors)
+            ids.push_back(d.id);
+        removeNodes(ids);
+    };
+    try {
+        addEdges(edgeDescriptors);
+    } catch(const out_of_range&){
+        rollback();
+        throw runtime_error("An edge has an endpoint that does not exist");
+    } catch(...){
+        rollback();
+        throw;
+    }
+}
+
+void GraphViewer::removeNodes(const vector<id_t> &ids){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    for(const id_t &id: ids)
+        nodes.at(id);
+
+    for(const id_t &id: ids){
+        Node *node = nodes.get(id);
+        if(node == nullptr) continue;
+        while(!node->edges.empty()){
+            Edge *edge = node->edges.back();
+            edge->detach();
+            releaseEdge(edge);
+            edges.erase(edge->getId());
+            edgePool.destroy(edge);
+        }
+        releaseNode(node);
+        nodes.erase(id);
+        nodePool.destroy(node);
+    }
+    if(zipEdges && isZipFragmented()) updateZip();
+}
+
+void GraphViewer::setPositions(const vector<id_t> &ids, const vector<Vector2f> &positions){
+    if(ids.size() != positions.size())
+        throw invalid_argument("Number of IDs and positions do not match");
+    setPositions(ids.data(), positions.data(), ids.size());
+}
+
+void GraphViewer::setPositions(const id_t *ids, const Vector2f *positions, size_t n){
+    lock_guard<mutex> lock(graphMutex);
+    vector<Node*> moved;
+    moved.reserve(n);
+    for(size_t i = 0; i < n; ++i)
+        moved.push_back(nodes.at(ids[i]));
+    setPositions_noLock(moved, positions);
+}
+
+void GraphViewer::setPositions(const Vector2f *positions, size_t n){
+    lock_guard<mutex> lock(graphMutex);
+    vector<Node*> moved;
+    moved.reserve(n);
+    for(size_t i = 0; i < n; ++i)
+        moved.push_back(nodes.at(id_t(i)));
+    setPositions_noLock(moved, positions);
+}
+
+void GraphViewer::setPositions_noLock(const vector<Node*> &moved, const Vector2f *positions){
+    requestRedraw();
+    for(size_t i = 0; i < moved.size(); ++i){
+        Node *node = moved[i];
+        if(node->position == positions[i]) continue;
+        node->position = positions[i];
+        if(!node->dirty){
+            node->dirty = true;
+            dirtyNodes.push_back(node->getId());
+        }
+    }
+    if(!deferredUpdates) flushUpdates();
+}
+
+void GraphViewer::clear(){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    edges.clear();
+    nodes.clear();
+    edgePool.clear();
+    nodePool.clear();
+    dirtyNodes.clear();
+    dirtyEdges.clear();
+    zip.clear();
+    dashZip.clear();
+    nodeZip.clear();
+    nodeGrid.clear();
+    edgeGrid.clear();
+    nodeLabelZip.invalidate();
+    edgeLabelZip.invalidate();
+    nodeSizes.clear();
+    edgeThicknesses.clear();
+    labelSizes.clear();
+    ++removals;
 }
 
 void GraphViewer::setBackgroundColor(const sf::Color &color){
     lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
     background_color = color;
 }
 
@@ -200,9 +721,12 @@ const sf::Color &GraphViewer::getBackgroundColor() const {
 }
 
 void GraphViewer::setBackground(const string &path, const sf::Vector2f &position, const sf::Vector2f &scale, double alpha){
+    TextureCache::Handle texture = TextureCache::getInstance().get(path);
     lock_guard<mutex> lock(graphMutex);
-    background_texture.loadFromFile(path);
-    background_sprite.setTexture(background_texture);
+    requestRedraw();
+    background_texture = texture;
+    background_sprite.setTexture(background_texture->getTexture(), true);
+    background_sprite.setTextureRect(background_texture->getTextureRect());
     background_sprite.setPosition(position);
     background_sprite.setScale(scale);
     background_sprite.setColor(sf::Color(255, 255, 255, (unsigned char)(alpha*255.0)));
@@ -210,41 +734,318 @@ void GraphViewer::setBackground(const string &path, const sf::Vector2f &position
 
 void GraphViewer::clearBackground(){
     lock_guard<mutex> lock(graphMutex);
-    background_texture = Texture();
-    background_sprite.setTexture(background_texture);
+    requestRedraw();
+    background_texture = nullptr;
+    background_sprite = Sprite();
 }
 
 void GraphViewer::join(){
 #ifndef WORKER_THREAD_CANT_HANDLE
-    main_thread->join();
+    if(main_thread != nullptr){
+        main_thread->join();
+    } else {
+        unique_lock<mutex> lock(isWindowOpenCVMutex);
+        isWindowOpenCV.wait(lock, [this]{ return !windowOpen.load(); });
+    }
 #endif
 }
 
-void GraphViewer::setEnabledNodes(bool b){ enabledNodes = b; }
-void GraphViewer::setEnabledEdges(bool b){ enabledEdges = b; }
-void GraphViewer::setEnabledNodesText(bool b){ enabledNodesText = b; }
-void GraphViewer::setEnabledEdgesText(bool b){ enabledEdgesText = b; }
+void GraphViewer::setRenderScheduler(RenderScheduler *scheduler){
+    if(window != nullptr) throw runtime_error("Window was already created");
+    this->scheduler = scheduler;
+}
+
+void GraphViewer::setEnabledNodes(bool b){ enabledNodes = b; requestRedraw(); }
+void GraphViewer::setEnabledEdges(bool b){ enabledEdges = b; requestRedraw(); }
+void GraphViewer::setEnabledNodesText(bool b){ enabledNodesText = b; requestRedraw(); }
+void GraphViewer::setEnabledEdgesText(bool b){ enabledEdgesText = b; requestRedraw(); }
 
 void GraphViewer::setZipEdges(bool b){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
     zipEdges = b;
     if(zipEdges) updateZip();
+    else {
+        zip.clear();
+        dashZip.clear();
+        for(Edge &edge: edgePool){
+            edge.zip = nullptr;
+            edge.zipSlot = ZipEdges::Slot();
+        }
+    }
+}
+
+void GraphViewer::setTexturedDashes(bool b){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    texturedDashes = b;
+    invalidateDashedEdges();
+}
+
+void GraphViewer::setDashFill(float fill){
+    if(!(fill > 0.0f && fill <= 1.0f))
+        throw invalid_argument("Dash fill must be in ]0, 1]");
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    dashFill = fill;
+    // Textured dashes only need a new texture, which is made when drawn
+    if(!texturedDashes) invalidateDashedEdges();
+}
+
+void GraphViewer::invalidateDashedEdges(){
+    for(Edge &edge: edgePool)
+        if(edge.getDashed()) edge.invalidate();
+}
+
+bool GraphViewer::isZipFragmented() const{
+    return zip.isFragmented() || dashZip.isFragmented();
+}
+
+const Texture& GraphViewer::getDashTexture(){
+    if(dashTexture == nullptr || dashTextureFill != dashFill){
+        // Dash followed by a gap, with partial coverage where the dash ends
+        const unsigned size = DashedLineShape::patternSize;
+        Image image;
+        image.create(size, 1, Color::Transparent);
+        for(unsigned x = 0; x < size; ++x){
+            float alpha = min(max(dashFill*float(size) - float(x), 0.0f), 1.0f);
+            image.setPixel(x, 0, Color(255, 255, 255, Uint8(alpha*255.0f)));
+        }
+        // A new texture, as a snapshot may still be drawing the old one
+        dashTexture = make_shared<Texture>();
+        dashTexture->loadFromImage(image);
+        dashTexture->setRepeated(true);
+        dashTextureFill = dashFill;
+    }
+    return *dashTexture;
+}
+
+void GraphViewer::setZipNodes(bool b){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    zipNodes = b;
+    nodeZip.clear();
+    for(Node &node: nodePool){
+        node.zip = (zipNodes ? &nodeZip : nullptr);
+        node.zipSlot = ZipNodes::Slot();
+        node.updateZip();
+    }
+}
+
+void GraphViewer::setZipLabels(bool b){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    zipLabels = b;
+    nodeLabelZip.invalidate();
+    edgeLabelZip.invalidate();
+    if(!zipLabels){
+        for(Node &node: nodePool) node.labelZipped = false;
+        for(Edge &edge: edgePool) edge.labelZipped = false;
+    }
+}
+
+void GraphViewer::updateLabelZip(){
+    // Labels that are not shown are left dirty, so they are only laid out
+    // once they are shown
+    if(enabledNodes && enabledNodesText && nodeLabelZip.isDirty()){
+        nodeLabelZip.clear();
+        for(Node &node: nodePool){
+            node.labelZipped = (node.isEnabled() && !node.getText().getString().isEmpty());
+            if(node.labelZipped) nodeLabelZip.append(node.getText());
+        }
+        nodeLabelZip.validate();
+    }
+    if(enabledEdges && enabledEdgesText && edgeLabelZip.isDirty()){
+        edgeLabelZip.clear();
+        for(Edge &edge: edgePool){
+            edge.labelZipped = (edge.isEnabled() && edge.text != nullptr);
+            if(edge.labelZipped) edgeLabelZip.append(edge.getText());
+        }
+        edgeLabelZip.validate();
+    }
+}
+
+void GraphViewer::setLevelOfDetail(bool b){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    levelOfDetail = b;
+}
+
+void GraphViewer::setLevelOfDetail(const LevelOfDetail &lod){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    this->lod = lod;
+}
+
+void GraphViewer::setSnapshotRendering(bool b){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    // The snapshot may be being drawn unlocked, so it is only freed by the
+    // window thread
+    snapshotRendering = b;
+}
+
+void GraphViewer::setDeferredUpdates(bool b){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    deferredUpdates = b;
+    if(!deferredUpdates) flushUpdates();
+}
+
+void GraphViewer::flushUpdates(){
+    for(const id_t &id: dirtyNodes){
+        Node *node = nodes.get(id);
+        if(node == nullptr) continue;
+        if(!node->dirty) continue;
+        node->dirty = false;
+        node->updateShape();
+        // Mark edges instead of updating them, so each is updated only once
+        for(Edge *e: node->edges){
+            if(e->dirty) continue;
+            e->dirty = true;
+            dirtyEdges.push_back(e->getId());
+        }
+    }
+    dirtyNodes.clear();
+
+    flushEdges.clear();
+    for(const id_t &id: dirtyEdges){
+        Edge *edge = edges.get(id);
+        if(edge == nullptr) continue;
+        if(!edge->dirty) continue;
+        edge->dirty = false;
+        flushEdges.push_back(edge);
+    }
+    dirtyEdges.clear();
+
+    // Zips and the spatial index are shared, so they are updated serially
+    updateEdgeShapes(flushEdges);
+    for(Edge *edge: flushEdges){
+        edge->updateText();
+        edge->updateGraph();
+    }
+}
+
+void GraphViewer::updateEdgeShapes(const vector<Edge*> &edges){
+    LineBatch lines(false), arrows(true);
+    vector<Edge*> others;
+    for(Edge *edge: edges){
+        if(edge->getThickness() <= 0.0 || edge->getDashed()){
+            others.push_back(edge);
+            continue;
+        }
+        const Node *u = edge->u, *v = edge->v;
+        bool directed = (edge->edge_type == Edge::EdgeType::DIRECTED);
+        if(edge->shape == nullptr){
+            edge->shape = new LineShape(u->getPosition(), v->getPosition(), 0);
+        } else {
+            edge->shape->setFrom(u->getPosition());
+            edge->shape->setTo  (v->getPosition());
+        }
+        edge->shape->resize(LineBatch::getVertexCount(directed));
+        (directed ? arrows : lines).add(u->getPosition(), v->getPosition(), u->getSize()/2.0f, v->getSize()/2.0f, edge->getThickness(), edge->getColor(), &(*edge->shape)[0]);
+    }
+
+    // One parallel loop over lines, then arrows, then other edges
+    const size_t arrowsBegin = lines.size(), othersBegin = arrowsBegin + arrows.size();
+    WorkerPool::getInstance().parallelFor(othersBegin + others.size(), [&](size_t begin, size_t end){
+        if(begin < arrowsBegin) lines.build(begin, min(end, arrowsBegin));
+        if(begin < othersBegin && end > arrowsBegin)
+            arrows.build(max(begin, arrowsBegin) - arrowsBegin, min(end, othersBegin) - arrowsBegin);
+        for(size_t i = max(begin, othersBegin); i < end; ++i)
+            others[i - othersBegin]->updateShape();
+    });
+}
+
+void GraphViewer::setViewportCulling(bool b, float cellSize){
+    lock_guard<mutex> lock(graphMutex);
+    requestRedraw();
+    viewportCulling = b;
+    nodeGrid = SpatialGrid<Node*>(cellSize);
+    edgeGrid = SpatialGrid<Edge*>(cellSize);
+    if(!viewportCulling) return;
+    for(Node &node: nodePool)
+        if(node.getShape() != nullptr) nodeGrid.insert(&node, node.getBounds());
+    for(Edge &edge: edgePool)
+        if(edge.getShape() != nullptr) edgeGrid.insert(&edge, edge.getBounds());
+}
+
+GraphViewer::FrameStats GraphViewer::getFrameStats() const {
+    lock_guard<mutex> lock(frameStatsMutex);
+    return lastFrameStats;
+}
+
+FPSMonitor::Statistics GraphViewer::getFrameTimes() const {
+    lock_guard<mutex> lock(frameStatsMutex);
+    return fps_monitor.getStatistics();
+}
+
+float GraphViewer::getFPS() const {
+    lock_guard<mutex> lock(frameStatsMutex);
+    return fps_monitor.getFPS();
 }
 
 void GraphViewer::lock  (){ graphMutex.lock  (); }
-void GraphViewer::unlock(){ graphMutex.unlock(); }
+void GraphViewer::unlock(){ graphMutex.unlock(); requestRedraw(); }
+
+void GraphViewer::setRenderOnDemand(bool b){
+    renderOnDemand = b;
+    requestRedraw();
+}
+
+void GraphViewer::setFramerateLimit(unsigned limit){
+    framerateLimit = limit;
+    windowSettingsChanged = true;
+    requestRedraw();
+}
+
+void GraphViewer::setVerticalSync(bool b){
+    verticalSync = b;
+    windowSettingsChanged = true;
+    requestRedraw();
+}
+
+void GraphViewer::requestRedraw(){
+    if(!redrawRequested.exchange(true)){
+        if(scheduler != nullptr && windowOpen) scheduler->wake(this);
+        else {
+            // Lock so the notification cannot fall between the window
+            // thread checking redrawRequested and starting to wait
+            lock_guard<mutex> lock(redrawMutex);
+            redrawCV.notify_all();
+        }
+    }
+}
 
 void GraphViewer::updateZip(){
-    lock_guard<mutex> lock(graphMutex);
-    zip = ZipEdges();
-    for(const auto &p: edges) {
-        const Edge *e = p.second;
-        if(!e->isEnabled()) continue;
-        const VertexArray *shape = e->getShape();
-        if(shape != nullptr) zip.append(*shape);
+    zip.clear();
+    dashZip.clear();
+    for(Edge &e: edgePool) {
+        e.zip = &zip;
+        e.zipSlot = ZipEdges::Slot();
+        e.updateZip();
     }
 }
 
 void GraphViewer::run(){
+    openWindow();
+    while (window->isOpen()){
+        SteadyClock::time_point frameStart = SteadyClock::now();
+        processEvents();
+        if(isFrameRequested()){
+            renderFrame(frameStart);
+        } else {
+            // Requests always wake the thread up; the timeout is only to
+            // poll window events, which SFML cannot wait for together with
+            // a condition variable
+            unique_lock<mutex> lock(redrawMutex);
+            redrawCV.wait_for(lock, chrono::milliseconds(int(IDLE_POLL_INTERVAL)), [this]{ return redrawRequested.load(); });
+        }
+    }
+    finishWindow();
+}
+
+void GraphViewer::openWindow(){
     ContextSettings settings;
     settings.antialiasingLevel = 8;
     GraphViewer::createWindowMutex.lock();
@@ -254,129 +1055,394 @@ void GraphViewer::run(){
     view = new View(window->getDefaultView());
     debug_view = new View(window->getDefaultView());
 
-    bool isLeftClickPressed = false;
-    Vector2f centerInitial;
-    Vector2f posMouseInitial;
-
+    isLeftClickPressed = false;
     recalculateView();
     {
         lock_guard<mutex> lock(isWindowOpenCVMutex);
         windowOpen = true;
         isWindowOpenCV.notify_all();
     }
-    while (window->isOpen()){
-        Event event{};
-        while (window->pollEvent(event)){
-            switch(event.type){
-                case Event::Closed            : window->close(); break;
-                case Event::Resized           : onResize(); break;
-                case Event::MouseWheelScrolled: onScroll(event.mouseWheelScroll.delta); break;
-                case Event::MouseButtonPressed:
-                    switch(event.mouseButton.button){
-                        case Mouse::Button::Left:
-                            isLeftClickPressed = true;
-                            centerInitial = center;
-                            posMouseInitial = Vector2f(
-                                (float) event.mouseButton.x,
-                                (float) event.mouseButton.y
-                            );
-                            break;
-                        default: break;
-                    }
-                    break;
-                case Event::MouseButtonReleased:
-                    switch(event.mouseButton.button){
-                        case Mouse::Button::Left:
-                            isLeftClickPressed = false;
-                            break;
-                        default: break;
-                    }
-                    break;
-                case Event::MouseMoved:
-                    if(isLeftClickPressed){
-                        Vector2f mouse_pos(
-                            (float) event.mouseMove.x,
-                            (float) event.mouseMove.y
+}
+
+void GraphViewer::processEvents(){
+    if(windowSettingsChanged.exchange(false)){
+        // A scheduler paces frames itself, as blocking in display() would
+        // stall its other windows
+        window->setFramerateLimit(scheduler == nullptr ? framerateLimit.load() : 0);
+        window->setVerticalSyncEnabled(scheduler == nullptr && verticalSync);
+    }
+    Event event{};
+    while (window->pollEvent(event)){
+        redrawRequested = true;
+        switch(event.type){
+            case Event::Closed            : window->close(); break;
+            case Event::Resized           : onResize(); break;
+            case Event::MouseWheelScrolled: onScroll(event.mouseWheelScroll.delta); break;
+            case Event::MouseButtonPressed:
+                switch(event.mouseButton.button){
+                    case Mouse::Button::Left:
+                        isLeftClickPressed = true;
+                        centerInitial = center;
+                        posMouseInitial = Vector2f(
+                            (float) event.mouseButton.x,
+                            (float) event.mouseButton.y
                         );
-                        center = centerInitial - (mouse_pos - posMouseInitial)*scale;
-                        recalculateView();
-                    }
-                    break;
-                case Event::TextEntered:
-                    switch(toupper((int) event.text.unicode)){
-                        case 'D': debug_mode = !debug_mode; break;
-                        default: break;
-                    }
-                    break;
-                default: break;
-            }
+                        break;
+                    default: break;
+                }
+                break;
+            case Event::MouseButtonReleased:
+                switch(event.mouseButton.button){
+                    case Mouse::Button::Left:
+                        isLeftClickPressed = false;
+                        break;
+                    default: break;
+                }
+                break;
+            case Event::MouseMoved:
+                if(isLeftClickPressed){
+                    Vector2f mouse_pos(
+                        (float) event.mouseMove.x,
+                        (float) event.mouseMove.y
+                    );
+                    center = centerInitial - (mouse_pos - posMouseInitial)*scale;
+                    recalculateView();
+                }
+                break;
+            case Event::TextEntered:
+                switch(toupper((int) event.text.unicode)){
+                    case 'D': debug_mode = !debug_mode; break;
+                    default: break;
+                }
+                break;
+            default: break;
         }
-        draw();
-        window->display();
     }
+}
 
-    {
-        lock_guard<mutex> lock(graphMutex);
-        windowOpen = false;
-    }
+bool GraphViewer::isFrameRequested(){
+    return !renderOnDemand || redrawRequested.exchange(false);
+}
+
+void GraphViewer::renderFrame(const chrono::steady_clock::time_point &frameStart){
+    frameStats = FrameStats();
+    frameStats.eventsTime = millisecondsSince(frameStart);
+    draw();
+    SteadyClock::time_point displayStart = SteadyClock::now();
+    window->display();
+    frameStats.displayTime = millisecondsSince(displayStart);
+    frameStats.frameTime = millisecondsSince(frameStart);
+    lock_guard<mutex> lock(frameStatsMutex);
+    lastFrameStats = frameStats;
+    // Only the time drawing the frame, so idle time waiting for a redraw
+    // request does not count as a slow frame
+    fps_monitor.count(frameStats.frameTime);
+}
+
+void GraphViewer::finishWindow(){
+    lock_guard<mutex> lock(isWindowOpenCVMutex);
+    windowOpen = false;
+    isWindowOpenCV.notify_all();
 }
 
 void GraphViewer::draw() {
+    SteadyClock::time_point start = SteadyClock::now();
+    unique_lock<mutex> lock(graphMutex);
+    frameStats.lockTime += millisecondsSince(start);
+    if(!snapshotRendering) snapshot.clear();
+    drawScene(*window, *view, pixelsPerUnit, (snapshotRendering ? &lock : nullptr), windowPass, frameStats);
+
+    if(debug_mode){
+        drawDebug();
+    }
+}
+
+void GraphViewer::drawScene(RenderTarget &target, const View &view, float pixelsPerUnit, unique_lock<mutex> *lock, RenderPass &pass, FrameStats &stats){
+    SteadyClock::time_point start = SteadyClock::now();
+    flushUpdates();
+    target.clear(background_color);
+
+    target.setView(view);
+    if(background_texture != nullptr) drawCounted(target, background_sprite, 4, stats);
+
+    updateVisible(view, pass);
+    stats.visibleNodes = pass.visibleNodes.size();
+    stats.visibleEdges = pass.visibleEdges.size();
+    stats.totalNodes   = nodes.size();
+    stats.totalEdges   = edges.size();
+
+    bool edgesAsLines  = levelOfDetail && edgeThicknesses.get()*pixelsPerUnit < lod.edgeLineThickness;
+    bool nodesAsPoints = levelOfDetail && nodeSizes      .get()*pixelsPerUnit < lod.nodePointSize;
+    bool hideLabels    = levelOfDetail && labelSizes     .get()*pixelsPerUnit < lod.labelMinSize;
+    pass.edgeMinLength = lod.edgeMinLength/pixelsPerUnit;
+
+    if(lock != nullptr){
+        updateSnapshot(pass, edgesAsLines, nodesAsPoints);
+        lock->unlock();
+        stats.prepareTime += millisecondsSince(start);
+        start = SteadyClock::now();
+        snapshot.drawEdges(target, stats);
+        stats.edgesTime += millisecondsSince(start);
+        start = SteadyClock::now();
+        snapshot.drawNodes(target, stats);
+        stats.nodesTime += millisecondsSince(start);
+        start = SteadyClock::now();
+        lock->lock();
+        stats.lockTime += millisecondsSince(start);
+        start = SteadyClock::now();
+        if(pass.visibleRemovals != removals) updateVisible(view, pass);
+        if(enabledNodes && !nodesAsPoints) drawIcons(target, pass, stats);
+        stats.nodesTime += millisecondsSince(start);
+    } else {
+        stats.prepareTime += millisecondsSince(start);
+        start = SteadyClock::now();
+        if(enabledEdges) drawEdges(target, pass, edgesAsLines, stats);
+        stats.edgesTime += millisecondsSince(start);
+        start = SteadyClock::now();
+        if(enabledNodes) drawNodes(target, pass, nodesAsPoints, stats);
+        stats.nodesTime += millisecondsSince(start);
+    }
+    start = SteadyClock::now();
+    if(!hideLabels) drawLabels(target, pass, stats);
+    stats.labelsTime += millisecondsSince(start);
+}
+
+Image GraphViewer::renderToImage(unsigned int width, unsigned int height, const sf::Vector2f &center, float scale){
     lock_guard<mutex> lock(graphMutex);
-    window->clear(background_color);
-
-    window->setView(*view);
-    window->draw(background_sprite);
-    if(enabledEdges){
-        if(zipEdges){
-            const vector<Vertex> &v = zip.getVertices();
-            window->draw(&v[0], v.size(), Quads);
+    if(offscreen == nullptr || offscreen->getSize() != Vector2u(width, height)){
+        lock_guard<mutex> createLock(createWindowMutex);
+        if(offscreen == nullptr) offscreen = new RenderTexture();
+        ContextSettings settings;
+        settings.antialiasingLevel = 8;
+        if(!offscreen->create(width, height, settings))
+            throw runtime_error("Failed to create offscreen render texture");
+    }
+    View offscreenView(center, Vector2f(float(width), float(height))*scale);
+    RenderPass pass;
+    FrameStats stats;
+    drawScene(*offscreen, offscreenView, 1.0f/scale, nullptr, pass, stats);
+    offscreen->display();
+    return offscreen->getTexture().copyToImage();
+}
+
+void GraphViewer::renderToFile(const string &path, unsigned int width, unsigned int height, const sf::Vector2f &center, float scale){
+    Image image = renderToImage(width, height, center, scale);
+    if(!image.saveToFile(path))
+        throw runtime_error("Failed to save image to file '" + path + "'");
+}
+
+void GraphViewer::updateVisible(const View &view, RenderPass &pass){
+    pass.visibleNodes.clear();
+    pass.visibleEdges.clear();
+    if(viewportCulling){
+        FloatRect viewRect(view.getCenter() - view.getSize()/2.0f, view.getSize());
+        if(enabledNodes) nodeGrid.query(viewRect, pass.visibleNodes);
+        if(enabledEdges) edgeGrid.query(viewRect, pass.visibleEdges);
+    } else {
+        if(enabledNodes) for(Node &node: nodePool) pass.visibleNodes.push_back(&node);
+        if(enabledEdges) for(Edge &edge: edgePool) pass.visibleEdges.push_back(&edge);
+    }
+    pass.visibleRemovals = removals;
+}
+
+void GraphViewer::makeEdgeLines(const RenderPass &pass, vector<Vertex> &vertices) const{
+    const float edgeMinLength = pass.edgeMinLength;
+    vertices.clear();
+    for(const Edge *edge: pass.visibleEdges){
+        if(!edge->isEnabled() || edge->getShape() == nullptr) continue;
+        const Vector2f &u = edge->getFrom()->getPosition();
+        const Vector2f &v = edge->getTo  ()->getPosition();
+        Vector2f uv = v - u;
+        if(uv.x*uv.x + uv.y*uv.y < edgeMinLength*edgeMinLength) continue;
+        vertices.push_back(Vertex(u, edge->getColor()));
+        vertices.push_back(Vertex(v, edge->getColor()));
+    }
+}
+
+void GraphViewer::makeNodePoints(const RenderPass &pass, vector<Vertex> &vertices) const{
+    vertices.clear();
+    for(const Node *node: pass.visibleNodes){
+        if(!node->isEnabled() || node->getShape() == nullptr) continue;
+        vertices.push_back(Vertex(node->getPosition(), node->getColor()));
+    }
+}
+
+void GraphViewer::updateSnapshot(const RenderPass &pass, bool edgesAsLines, bool nodesAsPoints){
+    snapshot.nodes.clear();
+    snapshot.dashTexture = nullptr;
+    if(texturedDashes){
+        getDashTexture();
+        snapshot.dashTexture = dashTexture;
+    }
+    if(enabledEdges && !edgesAsLines && zipEdges && !viewportCulling){
+        // All edges are drawn, so zips are copied whole, but only once
+        // after each change, to keep the time graphMutex is held short
+        if(isZipFragmented()) updateZip();
+        if(!snapshot.zipped || snapshot.edgesVersion != zip.getVersion()){
+            snapshot.edges = zip.getVertices();
+            snapshot.edgesVersion = zip.getVersion();
+        }
+        if(!snapshot.zipped || snapshot.dashedEdgesVersion != dashZip.getVersion()){
+            snapshot.dashedEdges = dashZip.getVertices();
+            snapshot.dashedEdgesVersion = dashZip.getVersion();
+        }
+        snapshot.zipped = true;
+        snapshot.edgesType = Quads;
+    } else {
+        snapshot.zipped = false;
+        snapshot.edges.clear();
+        snapshot.dashedEdges.clear();
+    }
+    if(enabledEdges && !snapshot.zipped){
+        if(edgesAsLines){
+            makeEdgeLines(pass, snapshot.edges);
+            snapshot.edgesType = Lines;
         } else {
-            for(const auto &edgeIt: edges){
-                const Edge &edge = *edgeIt.second;
-                if(!edge.isEnabled()) continue;
-                const VertexArray *shape = edge.getShape();
-                if(shape != nullptr) window->draw(*shape);
+            // Copy visible edges only; if culling, usually far fewer than
+            // all zipped edges
+            for(const Edge *edge: pass.visibleEdges){
+                if(!edge->isEnabled()) continue;
+                const VertexArray *shape = edge->getShape();
+                if(shape == nullptr) continue;
+                vector<Vertex> &v = (texturedDashes && edge->getDashed() ? snapshot.dashedEdges : snapshot.edges);
+                for(size_t i = 0; i < shape->getVertexCount(); ++i)
+                    v.push_back((*shape)[i]);
             }
+            snapshot.edgesType = Quads;
         }
     }
     if(enabledNodes){
-        for(const auto &nodeIt: nodes){
-            const Node &node = *nodeIt.second;
-            if(!node.isEnabled()) continue;
-            const Shape *shape = node.getShape();
-            if(shape != nullptr) window->draw(*shape);
+        if(nodesAsPoints){
+            makeNodePoints(pass, snapshot.nodes);
+            snapshot.nodesType = Points;
+            snapshot.nodesTexture = nullptr;
+        } else {
+            for(const Node *node: pass.visibleNodes){
+                if(!node->isEnabled() || node->getIsIcon() || node->getShape() == nullptr) continue;
+                snapshot.nodes.resize(snapshot.nodes.size() + 8);
+                ZipNodes::writeCircle(*node, &snapshot.nodes[snapshot.nodes.size() - 8]);
+            }
+            snapshot.nodesType = Quads;
+            snapshot.nodesTexture = &nodeZip.getDisc();
         }
     }
-    if(enabledEdges && enabledEdgesText){
-        for(const auto &edgeIt: edges){
-            const Edge &edge = *edgeIt.second;
-            if(!edge.isEnabled()) continue;
-            if(edge.getText().getString() != "")
-                window->draw(edge.getText());
+}
+
+void GraphViewer::FrameSnapshot::clear(){
+    edges = vector<Vertex>();
+    nodes = vector<Vertex>();
+    dashedEdges = vector<Vertex>();
+    dashTexture = nullptr;
+    zipped = false;
+}
+
+void GraphViewer::FrameSnapshot::drawEdges(RenderTarget &target, FrameStats &stats) const{
+    if(!edges.empty()) drawVertices(target, &edges[0], edges.size(), edgesType, stats);
+    if(!dashedEdges.empty()) drawVertices(target, &dashedEdges[0], dashedEdges.size(), Quads, stats, RenderStates(dashTexture.get()));
+}
+
+void GraphViewer::FrameSnapshot::drawNodes(RenderTarget &target, FrameStats &stats) const{
+    if(!nodes.empty()) drawVertices(target, &nodes[0], nodes.size(), nodesType, stats, RenderStates(nodesTexture));
+}
+
+void GraphViewer::drawEdges(RenderTarget &target, RenderPass &pass, bool asLines, FrameStats &stats){
+    if(asLines){
+        vector<Vertex> &lodVertices = pass.lodVertices;
+        makeEdgeLines(pass, lodVertices);
+        if(!lodVertices.empty()) drawVertices(target, &lodVertices[0], lodVertices.size(), Lines, stats);
+    } else if(zipEdges){
+        if(isZipFragmented()) updateZip();
+        const vector<Vertex> &v = zip.getVertices();
+        if(!v.empty()) drawVertices(target, &v[0], v.size(), Quads, stats);
+        const vector<Vertex> &d = dashZip.getVertices();
+        if(!d.empty()) drawVertices(target, &d[0], d.size(), Quads, stats, RenderStates(&getDashTexture()));
+    } else {
+        for(const Edge *edge: pass.visibleEdges){
+            if(!edge->isEnabled()) continue;
+            const VertexArray *shape = edge->getShape();
+            if(shape == nullptr) continue;
+            if(texturedDashes && edge->getDashed())
+                drawCounted(target, *shape, shape->getVertexCount(), stats, RenderStates(&getDashTexture()));
+            else
+                drawCounted(target, *shape, shape->getVertexCount(), stats);
         }
     }
-    if(enabledNodes && enabledNodesText){
-        for(const auto &nodeIt: nodes){
-            const Node &node = *nodeIt.second;
-            if(!node.isEnabled()) continue;
-            if(node.getText().getString() != "")
-                window->draw(node.getText());
+}
+
+void GraphViewer::drawNodes(RenderTarget &target, RenderPass &pass, bool asPoints, FrameStats &stats){
+    if(asPoints){
+        vector<Vertex> &lodVertices = pass.lodVertices;
+        makeNodePoints(pass, lodVertices);
+        if(!lodVertices.empty()) drawVertices(target, &lodVertices[0], lodVertices.size(), Points, stats);
+    } else if(zipNodes){
+        nodeZip.draw(target, stats);
+    } else {
+        for(const Node *node: pass.visibleNodes){
+            if(!node->isEnabled()) continue;
+            const Shape *shape = node->getShape();
+            if(shape != nullptr) drawCounted(target, *shape, stats);
         }
     }
+}
 
-    fps_monitor.count();
+void GraphViewer::drawIcons(RenderTarget &target, const RenderPass &pass, FrameStats &stats){
+    if(zipNodes){
+        nodeZip.drawIcons(target, stats);
+    } else {
+        for(const Node *node: pass.visibleNodes){
+            if(!node->isEnabled() || !node->getIsIcon()) continue;
+            const Shape *shape = node->getShape();
+            if(shape != nullptr) drawCounted(target, *shape, stats);
+        }
+    }
+}
 
-    if(debug_mode){
-        drawDebug();
+void GraphViewer::drawLabels(RenderTarget &target, const RenderPass &pass, FrameStats &stats){
+    if(zipLabels) updateLabelZip();
+    if(enabledEdges && enabledEdgesText){
+        if(zipLabels) edgeLabelZip.draw(target, stats);
+        else for(const Edge *edge: pass.visibleEdges){
+            if(!edge->isEnabled()) continue;
+            if(edge->text != nullptr)
+                drawCounted(target, edge->getText(), stats);
+        }
+    }
+    if(enabledNodes && enabledNodesText){
+        if(zipLabels) nodeLabelZip.draw(target, stats);
+        else for(const Node *node: pass.visibleNodes){
+            if(!node->isEnabled()) continue;
+            if(!node->getText().getString().isEmpty())
+                drawCounted(target, node->getText(), stats);
+        }
     }
 }
 
 void GraphViewer::drawDebug(){
     window->setView(*debug_view);
 
+    // Statistics of the previous frame, as the current one is not finished
+    const FrameStats &stats = lastFrameStats;
+    char buffer[256];
     string debugInfo;
     debugInfo += "FPS: " + to_string(int(fps_monitor.getFPS())) + "\n";
+    snprintf(buffer, sizeof(buffer), "Frame: %.2f ms (events %.2f, lock %.2f, prepare %.2f, edges %.2f, nodes %.2f, labels %.2f, display %.2f)\n",
+        stats.frameTime, stats.eventsTime, stats.lockTime, stats.prepareTime, stats.edgesTime, stats.nodesTime, stats.labelsTime, stats.displayTime);
+    debugInfo += buffer;
+    FPSMonitor::Statistics times = fps_monitor.getStatistics();
+    snprintf(buffer, sizeof(buffer), "Frame times: min %.2f, avg %.2f, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f ms\n",
+        times.min, times.avg, times.p50, times.p95, times.p99, times.max);
+    debugInfo += buffer;
+    debugInfo += "Histogram:";
+    for(size_t i = 0; i < FPSMonitor::HISTOGRAM_BUCKETS; ++i){
+        if(i+1 < FPSMonitor::HISTOGRAM_BUCKETS) snprintf(buffer, sizeof(buffer), " <%.0f:%u", FPSMonitor::getHistogramLimit(i), times.histogram[i]);
+        else snprintf(buffer, sizeof(buffer), " more:%u", times.histogram[i]);
+        debugInfo += buffer;
+    }
+    debugInfo += "\n";
+    debugInfo += "Draw calls: " + to_string(stats.drawCalls) + ", vertices: " + to_string(stats.vertices) + "\n";
+    debugInfo += "Nodes: " + to_string(stats.visibleNodes) + "/" + to_string(stats.totalNodes) + " visible, edges: " + to_string(stats.visibleEdges) + "/" + to_string(stats.totalEdges) + " visible\n";
+    if(zipLabels)
+        debugInfo += "Label vertices: " + to_string(nodeLabelZip.getVertexCount() + edgeLabelZip.getVertexCount()) + "\n";
 
     if(debugInfo[debugInfo.size()-1] == '\n')
         debugInfo = debugInfo.substr(0, debugInfo.size()-1);
@@ -401,10 +1467,10 @@ void GraphViewer::onScroll(float delta){
 void GraphViewer::recalculateView(){
     Vector2f size((float) window->getSize().x, (float) window->getSize().y);
     *view = View(center, size*scale);
+    pixelsPerUnit = 1.0f/scale;
     *debug_view = View(FloatRect(0.0, 0.0, size.x, size.y));
 }
 
 bool GraphViewer::isWindowOpen() const {
-    lock_guard<mutex> lock(graphMutex);
     return windowOpen;
 }
@@ -2,12 +2,20 @@
 
 #include <cmath>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GV_LINES_SSE2
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 using namespace sf;
 
 const float GraphViewer::ArrowHead::widthFactor   = 4.0;
 const float GraphViewer::ArrowHead::lengthFactor  = 4.0;
 const float GraphViewer::ArrowHead::advanceFactor = 1.0;
+const float GraphViewer::DashedLineShape::periodFactor = 4.0;
 
 GraphViewer::LineShape::LineShape(const Vector2f& u, const Vector2f& v, float w):
     VertexArray(Quads),
@@ -64,18 +72,30 @@ void GraphViewer::FullLineShape::process(){
     append(Vertex(v-edgeNorm));
 }
 
-GraphViewer::DashedLineShape::DashedLineShape(const Vector2f& u, const Vector2f& v, float w):
-    GraphViewer::LineShape(u,v,w)
+GraphViewer::DashedLineShape::DashedLineShape(const Vector2f& u, const Vector2f& v, float w, float dashFill):
+    GraphViewer::LineShape(u,v,w),
+    dashFill(dashFill)
 {
     process();
 }
 
+void GraphViewer::DashedLineShape::setTexCoords(Vertex *vertices, size_t n, float w){
+    const Vector2f start(0.5f, 0.5f);
+    for(size_t i = 0; i + 4 < n; ++i)
+        vertices[i].texCoords = start;
+    Vertex *quad = vertices + (n-4);
+    Vector2f d = quad[2].position - quad[1].position;
+    float end = sqrt(d.x*d.x + d.y*d.y)/(periodFactor*w)*float(patternSize);
+    quad[0].texCoords = quad[1].texCoords = Vector2f(0.0f, 0.5f);
+    quad[2].texCoords = quad[3].texCoords = Vector2f(end, 0.5f);
+}
+
 void GraphViewer::DashedLineShape::setFrom (const Vector2f& u){ LineShape::setFrom (u); process(); }
 void GraphViewer::DashedLineShape::setTo   (const Vector2f& v){ LineShape::setTo   (v); process(); }
 void GraphViewer::DashedLineShape::setWidth(             float  w){ LineShape::setWidth(w); process(); }
 
 void GraphViewer::DashedLineShape::process(){
-    float interDashesSpace = 4.0f*getWidth();
+    float interDashesSpace = periodFactor*getWidth();
     const Vector2f &u = getFrom();
     const Vector2f &v = getTo  ();
     Vector2f v_u = v-u;
@@ -153,3 +173,197 @@ sf::Vector2f GraphViewer::ArrowHead::getLineConnection() const {
     float lineLengthFactor = min(lengthFactor-advanceFactor, lengthFactor);
     return v - uvUnitVec*lineLengthFactor*getWidth();
 }
+
+namespace {
+    /**
+     * @brief Lanes of floats, with the operations the line kernel needs.
+     *
+     * There is one specialization per instruction set; the kernel is written
+     * once as a template over them.
+     */
+    struct Scalar {
+        static const size_t N = 1;
+        float x;
+        static Scalar load(const float *p){ return Scalar{*p}; }
+        static Scalar set(float f){ return Scalar{f}; }
+        void store(float *p) const { *p = x; }
+        friend Scalar operator+(Scalar a, Scalar b){ return Scalar{a.x+b.x}; }
+        friend Scalar operator-(Scalar a, Scalar b){ return Scalar{a.x-b.x}; }
+        friend Scalar operator*(Scalar a, Scalar b){ return Scalar{a.x*b.x}; }
+        friend Scalar operator/(Scalar a, Scalar b){ return Scalar{a.x/b.x}; }
+        friend Scalar sqrt(Scalar a){ return Scalar{std::sqrt(a.x)}; }
+        /// Negate lanes of t where a < b.
+        friend Scalar negateIfLess(Scalar t, Scalar a, Scalar b){ return Scalar{a.x < b.x ? -t.x : t.x}; }
+    };
+
+#if defined(__AVX__)
+    struct Lanes {
+        static const size_t N = 8;
+        __m256 x;
+        static Lanes load(const float *p){ return Lanes{_mm256_loadu_ps(p)}; }
+        static Lanes set(float f){ return Lanes{_mm256_set1_ps(f)}; }
+        void store(float *p) const { _mm256_storeu_ps(p, x); }
+        friend Lanes operator+(Lanes a, Lanes b){ return Lanes{_mm256_add_ps(a.x, b.x)}; }
+        friend Lanes operator-(Lanes a, Lanes b){ return Lanes{_mm256_sub_ps(a.x, b.x)}; }
+        friend Lanes operator*(Lanes a, Lanes b){ return Lanes{_mm256_mul_ps(a.x, b.x)}; }
+        friend Lanes operator/(Lanes a, Lanes b){ return Lanes{_mm256_div_ps(a.x, b.x)}; }
+        friend Lanes sqrt(Lanes a){ return Lanes{_mm256_sqrt_ps(a.x)}; }
+        friend Lanes negateIfLess(Lanes t, Lanes a, Lanes b){
+            __m256 mask = _mm256_cmp_ps(a.x, b.x, _CMP_LT_OQ);
+            return Lanes{_mm256_xor_ps(t.x, _mm256_and_ps(mask, _mm256_set1_ps(-0.0f)))};
+        }
+    };
+#elif defined(GV_LINES_SSE2)
+    struct Lanes {
+        static const size_t N = 4;
+        __m128 x;
+        static Lanes load(const float *p){ return Lanes{_mm_loadu_ps(p)}; }
+        static Lanes set(float f){ return Lanes{_mm_set1_ps(f)}; }
+        void store(float *p) const { _mm_storeu_ps(p, x); }
+        friend Lanes operator+(Lanes a, Lanes b){ return Lanes{_mm_add_ps(a.x, b.x)}; }
+        friend Lanes operator-(Lanes a, Lanes b){ return Lanes{_mm_sub_ps(a.x, b.x)}; }
+        friend Lanes operator*(Lanes a, Lanes b){ return Lanes{_mm_mul_ps(a.x, b.x)}; }
+        friend Lanes operator/(Lanes a, Lanes b){ return Lanes{_mm_div_ps(a.x, b.x)}; }
+        friend Lanes sqrt(Lanes a){ return Lanes{_mm_sqrt_ps(a.x)}; }
+        friend Lanes negateIfLess(Lanes t, Lanes a, Lanes b){
+            __m128 mask = _mm_cmplt_ps(a.x, b.x);
+            return Lanes{_mm_xor_ps(t.x, _mm_and_ps(mask, _mm_set1_ps(-0.0f)))};
+        }
+    };
+#else
+    typedef Scalar Lanes;
+#endif
+
+    /// Maximum number of vertices of a line: arrow head and full line.
+    const size_t MAX_VERTICES = 12;
+
+    /**
+     * @brief Compute vertices of V::N lines.
+     *
+     * @param p         Pointers to ux, uy, vx, vy, ut, vt and w of the first line
+     * @param arrows    True if lines end with an arrow head
+     * @param factors   Width, length and advance factors of arrow heads
+     * @param x         X coordinates of vertices, by vertex and then by line
+     * @param y         Y coordinates of vertices, by vertex and then by line
+     * @return size_t   Number of vertices of each line
+     */
+    template<class V>
+    size_t lineKernel(const float *const p[7], bool arrows, const float factors[3], float *x, float *y){
+        V ux = V::load(p[0]), uy = V::load(p[1]);
+        V vx = V::load(p[2]), vy = V::load(p[3]);
+        V ut = V::load(p[4]), vt = V::load(p[5]);
+        V w  = V::load(p[6]);
+
+        // Trim the line by ut/vt along its direction
+        V dx = vx-ux, dy = vy-uy;
+        V len = sqrt(dx*dx + dy*dy);
+        V tx = dx/len, ty = dy/len;
+        V ax = ux + tx*ut, ay = uy + ty*ut;
+        V bx = vx - tx*vt, by = vy - ty*vt;
+        // If trimming flipped the line, so does its direction
+        tx = negateIfLess(tx, len, ut+vt);
+        ty = negateIfLess(ty, len, ut+vt);
+        V nx = V::set(0.0f)-ty, ny = tx;
+
+        size_t k = 0;
+        auto emit = [&](V px, V py){
+            px.store(x + V::N*k);
+            py.store(y + V::N*k);
+            ++k;
+        };
+        if(arrows){
+            V halfWidth = V::set(factors[0]/2.0f)*w;
+            V length    = V::set(factors[1]     )*w;
+            V connect   = V::set(factors[1]-factors[2])*w;
+            V cx = bx - tx*connect, cy = by - ty*connect;
+            emit(bx, by);
+            emit(bx, by);
+            emit(bx - tx*length - nx*halfWidth, by - ty*length - ny*halfWidth);
+            emit(cx, cy);
+            emit(bx, by);
+            emit(bx, by);
+            emit(bx - tx*length + nx*halfWidth, by - ty*length + ny*halfWidth);
+            emit(cx, cy);
+            bx = cx;
+            by = cy;
+        }
+        V hw = V::set(0.5f)*w;
+        V hx = nx*hw, hy = ny*hw;
+        emit(ax - hx, ay - hy);
+        emit(ax + hx, ay + hy);
+        emit(bx + hx, by + hy);
+        emit(bx - hx, by - hy);
+        return k;
+    }
+}
+
+GraphViewer::LineBatch::LineBatch(bool arrows):
+    arrows(arrows)
+{}
+
+size_t GraphViewer::LineBatch::getVertexCount(bool arrows){
+    return (arrows ? 12 : 4);
+}
+
+void GraphViewer::LineBatch::buildLine(const Vector2f &u, const Vector2f &v, float uTrim, float vTrim, float width, const Color &color, bool arrows, Vertex *vertices){
+    const float factors[3] = {ArrowHead::widthFactor, ArrowHead::lengthFactor, ArrowHead::advanceFactor};
+    const float *const p[7] = {&u.x, &u.y, &v.x, &v.y, &uTrim, &vTrim, &width};
+    float x[MAX_VERTICES], y[MAX_VERTICES];
+    size_t count = lineKernel<Scalar>(p, arrows, factors, x, y);
+    for(size_t k = 0; k < count; ++k){
+        vertices[k].position = Vector2f(x[k], y[k]);
+        vertices[k].color = color;
+    }
+}
+
+void GraphViewer::LineBatch::add(const Vector2f &u, const Vector2f &v, float uTrim, float vTrim, float width, const Color &color, Vertex *vertices){
+    ux.push_back(u.x); uy.push_back(u.y);
+    vx.push_back(v.x); vy.push_back(v.y);
+    ut.push_back(uTrim); vt.push_back(vTrim);
+    w.push_back(width);
+    colors.push_back(color);
+    out.push_back(vertices);
+}
+
+size_t GraphViewer::LineBatch::size() const {
+    return out.size();
+}
+
+void GraphViewer::LineBatch::clear(){
+    ux.clear(); uy.clear();
+    vx.clear(); vy.clear();
+    ut.clear(); vt.clear();
+    w.clear();
+    colors.clear();
+    out.clear();
+}
+
+void GraphViewer::LineBatch::build(size_t begin, size_t end) const {
+    const float factors[3] = {ArrowHead::widthFactor, ArrowHead::lengthFactor, ArrowHead::advanceFactor};
+    float x[MAX_VERTICES*Lanes::N], y[MAX_VERTICES*Lanes::N];
+
+    size_t i = begin;
+    auto scatter = [&](size_t lanes, size_t stride, size_t count){
+        for(size_t j = 0; j < lanes; ++j){
+            Vertex *vertices = out[i+j];
+            for(size_t k = 0; k < count; ++k){
+                vertices[k].position = Vector2f(x[stride*k + j], y[stride*k + j]);
+                vertices[k].color = colors[i+j];
+            }
+        }
+    };
+    for(; i + Lanes::N <= end; i += Lanes::N){
+        const float *const p[7] = {&ux[i], &uy[i], &vx[i], &vy[i], &ut[i], &vt[i], &w[i]};
+        size_t count = lineKernel<Lanes>(p, arrows, factors, x, y);
+        scatter(Lanes::N, Lanes::N, count);
+    }
+    for(; i < end; ++i){
+        const float *const p[7] = {&ux[i], &uy[i], &vx[i], &vy[i], &ut[i], &vt[i], &w[i]};
+        size_t count = lineKernel<Scalar>(p, arrows, factors, x, y);
+        scatter(1, 1, count);
+    }
+}
+
+void GraphViewer::LineBatch::build() const {
+    build(0, size());
+}
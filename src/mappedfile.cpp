@@ -0,0 +1,81 @@
+#include "mappedfile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string &path){
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(file == INVALID_HANDLE_VALUE){
+        file = nullptr;
+        throw runtime_error("Could not open file " + path);
+    }
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize)){
+        CloseHandle(file);
+        throw runtime_error("Could not get size of file " + path);
+    }
+    size = size_t(fileSize.QuadPart);
+    if(size == 0) return;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mapping == NULL){
+        CloseHandle(file);
+        throw runtime_error("Could not map file " + path);
+    }
+    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(data == nullptr){
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw runtime_error("Could not map file " + path);
+    }
+}
+
+MappedFile::~MappedFile(){
+    if(data    != nullptr) UnmapViewOfFile(data);
+    if(mapping != nullptr) CloseHandle(mapping);
+    if(file    != nullptr) CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const string &path){
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) throw runtime_error("Could not open file " + path);
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        close(fd);
+        throw runtime_error("Could not get size of file " + path);
+    }
+    size = size_t(st.st_size);
+    if(size == 0){
+        close(fd);
+        return;
+    }
+    void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) throw runtime_error("Could not map file " + path);
+    madvise(p, size, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(p);
+}
+
+MappedFile::~MappedFile(){
+    if(data != nullptr) munmap(const_cast<char*>(data), size);
+}
+
+#endif
+
+const char* MappedFile::getData() const { return data; }
+size_t      MappedFile::getSize() const { return size; }
@@ -1,46 +1,70 @@
 #include "graphviewer.h"
 
+#include <algorithm>
+
 using namespace std;
 using namespace sf;
 
-GraphViewer::Node::Node(GraphViewer::id_t id, const Vector2f &position):
+static const Texture EMPTY_TEXTURE;
+
+GraphViewer::Node::Node(GraphViewer &graph, GraphViewer::id_t id, const Vector2f &position):
+    graph(&graph),
     id(id),
     position(position)
 {
     text.setFont         (GraphViewer::FONT     );
     text.setCharacterSize(GraphViewer::FONT_SIZE);
     text.setFillColor    (Color::Black          );
-    update();
+}
+
+GraphViewer::Node::~Node(){
+    delete shape;
 }
 
         GraphViewer::id_t   GraphViewer::Node::getId                (                           ) const { return id; }
-        void                GraphViewer::Node::setPosition          (const Vector2f &position   )       { this->position = position; update(); }
+const   vector<GraphViewer::Edge*>& GraphViewer::Node::getEdges (                           ) const { return edges; }
+        size_t              GraphViewer::Node::getDegree            (                           ) const { return edges.size(); }
+        void                GraphViewer::Node::setPosition          (const Vector2f &position   )       { this->position = position; invalidate(); }
 const   Vector2f&           GraphViewer::Node::getPosition          (                           ) const { return position; }
-        void                GraphViewer::Node::setSize              (float size                 )       { this->size = size; update(); }
+        void                GraphViewer::Node::setSize              (float size                 )       { this->size = size; invalidate(); }
         float               GraphViewer::Node::getSize              (                           ) const { return size; }
-        void                GraphViewer::Node::setLabel             (const string &label        )       { text.setString(label); update(); }
+        void                GraphViewer::Node::setLabel             (const string &label        )       { text.setString(label); invalidate(); }
         string              GraphViewer::Node::getLabel             (                           ) const { return text.getString(); }
-        void                GraphViewer::Node::setLabelColor        (const Color &color         )       { text.setFillColor(color); update(); }
+        void                GraphViewer::Node::setLabelColor        (const Color &color         )       { text.setFillColor(color); invalidate(); }
 const   sf::Color&          GraphViewer::Node::getLabelColor        (                           ) const { return text.getFillColor(); }
-        void                GraphViewer::Node::setLabelSize         (unsigned int size          )       { text.setCharacterSize(size); update(); }
+        void                GraphViewer::Node::setLabelSize         (unsigned int size          )       { text.setCharacterSize(size); invalidate(); }
         unsigned            GraphViewer::Node::getLabelSize         (                           ) const { return text.getCharacterSize(); }
-        void                GraphViewer::Node::setColor             (const Color &color         )       { this->color = color; update(); }
+        void                GraphViewer::Node::setColor             (const Color &color         )       { this->color = color; invalidate(); }
 const   Color&              GraphViewer::Node::getColor             (                           ) const { return color; }
-        void                GraphViewer::Node::setIcon              (const string &path         )       { if(path.empty()) icon = Texture(); else icon.loadFromFile(path); isIcon = (!path.empty()); update(); }
-const   Texture&            GraphViewer::Node::getIcon              (                           ) const { return icon; }
+        void                GraphViewer::Node::setIcon              (const string &path         )       { icon = (path.empty() ? nullptr : TextureCache::getInstance().get(path)); isIcon = (!path.empty()); iconPath = path; invalidate(); }
+const   Texture&            GraphViewer::Node::getIcon              (                           ) const { return (icon == nullptr ? EMPTY_TEXTURE : icon->getTexture()); }
+        IntRect             GraphViewer::Node::getIconRect          (                           ) const { return (icon == nullptr ? IntRect() : icon->getTextureRect()); }
         bool                GraphViewer::Node::getIsIcon            (                           ) const { return isIcon; }
-        void                GraphViewer::Node::setOutlineThickness  (float outlineThickness     )       { this->outlineThickness = outlineThickness; update(); }
+        void                GraphViewer::Node::setOutlineThickness  (float outlineThickness     )       { this->outlineThickness = outlineThickness; invalidate(); }
         float               GraphViewer::Node::getOutlineThickness  (                           ) const { return outlineThickness; }
-        void                GraphViewer::Node::setOutlineColor      (const Color &outlineColor  )       { this->outlineColor = outlineColor; update(); }
+        void                GraphViewer::Node::setOutlineColor      (const Color &outlineColor  )       { this->outlineColor = outlineColor; invalidate(); }
 const   Color&              GraphViewer::Node::getOutlineColor      (                           ) const { return outlineColor; }
 const   Shape*              GraphViewer::Node::getShape             (                           ) const { return shape; }
 const   Text&               GraphViewer::Node::getText              (                           ) const { return text; }
 
 void GraphViewer::Node::update(){
+    updateShape();
+    for(Edge *e: edges){
+        e->update();
+    }
+}
+
+void GraphViewer::Node::updateShape(){
     delete shape;
     shape = nullptr;
+    graph->labelSizes.set(lodLabelSize, (text.getString().isEmpty() ? 0.0f : float(text.getCharacterSize())));
     if(!getIsIcon()){
-        if(getSize() <= 0.0) return;
+        if(getSize() <= 0.0){
+            graph->nodeSizes.set(lodSize, 0.0f);
+            updateZip();
+            if(graph->viewportCulling) graph->nodeGrid.remove(this);
+            return;
+        }
         CircleShape *newShape = new CircleShape(getSize()/2.0f);
         newShape->setFillColor(getColor());
         newShape->setOutlineThickness(getOutlineThickness());
@@ -49,6 +73,7 @@ void GraphViewer::Node::update(){
     } else {
         RectangleShape *newShape = new RectangleShape(Vector2f(getSize(),getSize()));
         newShape->setTexture(&getIcon());
+        newShape->setTextureRect(getIconRect());
         shape = newShape;
     }
     shape->setOrigin(getSize()/2.0f, getSize()/2.0f);
@@ -57,17 +82,56 @@ void GraphViewer::Node::update(){
     FloatRect bounds = text.getLocalBounds();
     text.setPosition(getPosition() - Vector2f(bounds.width/2.0f, 0.8f*bounds.height));
 
-    for(Edge *e: edges){
-        e->update();
+    graph->nodeSizes.set(lodSize, getSize() + 2.0f*max(getOutlineThickness(), 0.0f));
+
+    updateZip();
+    if(graph->zipLabels && (labelZipped || !text.getString().isEmpty())) graph->nodeLabelZip.invalidate();
+    if(graph->viewportCulling) graph->nodeGrid.insert(this, getBounds());
+}
+
+FloatRect GraphViewer::Node::getBounds() const {
+    FloatRect ret(getPosition(), Vector2f(0, 0));
+    if(shape != nullptr) ret = shape->getGlobalBounds();
+    if(!text.getString().isEmpty()){
+        FloatRect t = text.getGlobalBounds();
+        float left   = min(ret.left, t.left);
+        float top    = min(ret.top , t.top );
+        float right  = max(ret.left+ret.width , t.left+t.width );
+        float bottom = max(ret.top +ret.height, t.top +t.height);
+        ret = FloatRect(left, top, right-left, bottom-top);
+    }
+    return ret;
+}
+
+void GraphViewer::Node::updateZip(){
+    if(zip == nullptr) return;
+    zip->write(zipSlot, this);
+}
+
+void GraphViewer::Node::invalidate(){
+    graph->requestRedraw();
+    if(!graph->deferredUpdates){
+        update();
+        return;
+    }
+    if(!dirty){
+        dirty = true;
+        graph->dirtyNodes.push_back(id);
     }
 }
 
 void GraphViewer::Node::enable() {
     enabled = true;
+    graph->requestRedraw();
+    updateZip();
+    if(graph->zipLabels && !text.getString().isEmpty()) graph->nodeLabelZip.invalidate();
 }
 
 void GraphViewer::Node::disable() {
     enabled = false;
+    graph->requestRedraw();
+    updateZip();
+    if(labelZipped) graph->nodeLabelZip.invalidate();
 }
 
 bool GraphViewer::Node::isEnabled() const {
@@ -0,0 +1,144 @@
+#include "renderscheduler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+RenderScheduler::RenderScheduler(unsigned threads){
+    unsigned hardware = thread::hardware_concurrency();
+    if(hardware != 0 && threads > hardware) threads = hardware;
+    if(threads == 0) threads = 1;
+    workers.reserve(threads);
+    for(unsigned i = 0; i < threads; ++i){
+        Worker *worker = new Worker();
+        workers.push_back(worker);
+        worker->thread = thread(&RenderScheduler::work, this, worker);
+    }
+}
+
+RenderScheduler::~RenderScheduler(){
+    {
+        lock_guard<mutex> lock(schedulerMutex);
+        stopping = true;
+        for(Worker *worker: workers) worker->cv.notify_all();
+    }
+    for(Worker *worker: workers){
+        worker->thread.join();
+        delete worker;
+    }
+}
+
+void RenderScheduler::setFrameRate(unsigned fps){
+    frameRate = fps;
+}
+
+size_t RenderScheduler::getThreads() const{
+    return workers.size();
+}
+
+void RenderScheduler::add(GraphViewer *graph){
+    lock_guard<mutex> lock(schedulerMutex);
+    if(stopping) throw runtime_error("Render scheduler is stopping");
+    if(assigned.count(graph)) throw invalid_argument("Window is already scheduled");
+    Worker *worker = *min_element(workers.begin(), workers.end(), [](const Worker *l, const Worker *r){
+        return l->count < r->count;
+    });
+    assigned[graph] = worker;
+    ++worker->count;
+    worker->added.push_back(graph);
+    worker->woken = true;
+    worker->cv.notify_all();
+}
+
+void RenderScheduler::remove(GraphViewer *graph){
+    unique_lock<mutex> lock(schedulerMutex);
+    auto it = assigned.find(graph);
+    if(it == assigned.end()) return;
+    Worker *worker = it->second;
+    worker->removed.push_back(graph);
+    worker->woken = true;
+    worker->cv.notify_all();
+    removedCV.wait(lock, [this, graph]{ return assigned.count(graph) == 0; });
+}
+
+void RenderScheduler::wake(GraphViewer *graph){
+    lock_guard<mutex> lock(schedulerMutex);
+    auto it = assigned.find(graph);
+    if(it == assigned.end()) return;
+    it->second->woken = true;
+    it->second->cv.notify_all();
+}
+
+void RenderScheduler::closed(Worker *worker, GraphViewer *graph){
+    graph->finishWindow();
+    lock_guard<mutex> lock(schedulerMutex);
+    assigned.erase(graph);
+    --worker->count;
+    removedCV.notify_all();
+}
+
+void RenderScheduler::work(Worker *worker){
+    vector<GraphViewer*> added, removed;
+    vector<Window> &windows = worker->windows;
+    while(true){
+        bool stop;
+        {
+            lock_guard<mutex> lock(schedulerMutex);
+            swap(added, worker->added);
+            swap(removed, worker->removed);
+            stop = stopping;
+        }
+
+        // Open and close windows
+        for(GraphViewer *graph: added){
+            graph->openWindow();
+            windows.push_back(Window{graph, clock::now()});
+        }
+        added.clear();
+        if(stop){
+            for(const Window &w: windows) removed.push_back(w.graph);
+        }
+        for(GraphViewer *graph: removed){
+            auto it = find_if(windows.begin(), windows.end(), [graph](const Window &w){ return w.graph == graph; });
+            if(it == windows.end()) continue;
+            graph->window->close();
+            *it = windows.back();
+            windows.pop_back();
+            closed(worker, graph);
+        }
+        removed.clear();
+        if(stop) break;
+
+        // Service windows
+        clock::time_point deadline = clock::now() + chrono::milliseconds(int(GraphViewer::IDLE_POLL_INTERVAL));
+        for(size_t i = 0; i < windows.size(); ){
+            Window &w = windows[i];
+            GraphViewer *graph = w.graph;
+            clock::time_point frameStart = clock::now();
+            graph->processEvents();
+            if(!graph->window->isOpen()){
+                windows[i] = windows.back();
+                windows.pop_back();
+                closed(worker, graph);
+                continue;
+            }
+            if(frameStart >= w.nextFrame && graph->isFrameRequested()){
+                graph->renderFrame(frameStart);
+                unsigned fps = graph->framerateLimit;
+                if(fps == 0) fps = frameRate;
+                w.nextFrame = (fps == 0 ? frameStart : frameStart + chrono::nanoseconds(1000000000/fps));
+            }
+            if(!graph->renderOnDemand || graph->redrawRequested)
+                deadline = min(deadline, w.nextFrame);
+            ++i;
+        }
+
+        // Sleep until a frame is due, events must be polled, or woken up
+        unique_lock<mutex> lock(schedulerMutex);
+        worker->cv.wait_until(lock, deadline, [worker, this]{
+            return worker->woken || stopping;
+        });
+        worker->woken = false;
+    }
+}
@@ -0,0 +1,324 @@
+#include "graphviewer.h"
+#include "mappedfile.h"
+#include "workerpool.h"
+
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+using namespace std;
+using namespace sf;
+
+namespace {
+    /**
+     * @brief Minimum size of the chunks a file is split into, in bytes.
+     */
+    const size_t MIN_CHUNK_SIZE = 1 << 16;
+
+    bool isSpace(char c){
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+    }
+
+    bool isDigit(char c){
+        return '0' <= c && c <= '9';
+    }
+
+    void skipSpaces(const char *&p, const char *end){
+        while(p != end && isSpace(*p)) ++p;
+    }
+
+    bool parseChar(const char *&p, const char *end, char c){
+        skipSpaces(p, end);
+        if(p == end || *p != c) return false;
+        ++p;
+        return true;
+    }
+
+    bool parseUnsigned(const char *&p, const char *end, uint64_t &x){
+        skipSpaces(p, end);
+        if(p == end || !isDigit(*p)) return false;
+        x = 0;
+        for(; p != end && isDigit(*p); ++p)
+            x = 10*x + uint64_t(*p - '0');
+        return true;
+    }
+
+    bool parseFloat(const char *&p, const char *end, float &x){
+        static const double POW10[] = {
+            1e0 , 1e1 , 1e2 , 1e3 , 1e4 , 1e5 , 1e6 , 1e7 , 1e8 , 1e9 ,
+            1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+            1e20, 1e21, 1e22
+        };
+        static const int MAX_DIGITS = 19;
+
+        skipSpaces(p, end);
+        bool negative = false;
+        if(p != end && (*p == '+' || *p == '-')){
+            negative = (*p == '-');
+            ++p;
+        }
+        uint64_t mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool any = false;
+        for(; p != end && isDigit(*p); ++p, any = true){
+            if(digits < MAX_DIGITS){ mantissa = 10*mantissa + uint64_t(*p - '0'); if(mantissa) ++digits; }
+            else ++exponent;
+        }
+        if(p != end && *p == '.'){
+            for(++p; p != end && isDigit(*p); ++p, any = true){
+                if(digits < MAX_DIGITS){ mantissa = 10*mantissa + uint64_t(*p - '0'); if(mantissa) ++digits; --exponent; }
+            }
+        }
+        if(!any) return false;
+        if(p != end && (*p == 'e' || *p == 'E')){
+            const char *q = p+1;
+            bool negativeExponent = false;
+            if(q != end && (*q == '+' || *q == '-')){
+                negativeExponent = (*q == '-');
+                ++q;
+            }
+            uint64_t e;
+            if(q != end && isDigit(*q) && parseUnsigned(q, end, e)){
+                e = min(e, uint64_t(1000));
+                exponent += (negativeExponent ? -int(e) : int(e));
+                p = q;
+            }
+        }
+        double value = double(mantissa);
+        while(exponent > 22){ value *= 1e22; exponent -= 22; }
+        while(exponent < -22){ value /= 1e22; exponent += 22; }
+        value = (exponent >= 0 ? value*POW10[exponent] : value/POW10[-exponent]);
+        x = float(negative ? -value : value);
+        return true;
+    }
+
+    /**
+     * @brief Parse a word (a non-empty sequence of non-space characters), as
+     *        scanf's %s does.
+     */
+    bool parseWord(const char *&p, const char *end, const char *&begin, size_t &length){
+        skipSpaces(p, end);
+        begin = p;
+        while(p != end && !isSpace(*p)) ++p;
+        length = size_t(p - begin);
+        return length > 0;
+    }
+
+    bool equalsIgnoreCase(const char *s, size_t length, const char *name){
+        for(size_t i = 0; i < length; ++i, ++name){
+            char c = s[i];
+            if('a' <= c && c <= 'z') c = char(c - 'a' + 'A');
+            if(c != *name) return false;
+        }
+        return *name == '\0';
+    }
+
+    bool parseColor(const char *&p, const char *end, Color &color){
+        static const pair<const char*, Color> COLORS[] = {
+            {"BLUE"      , Color::Blue       },
+            {"RED"       , Color::Red        },
+            {"PINK"      , Color(255, 192, 203)},
+            {"PURPLE"    , Color(128,   0, 128)},
+            {"BLACK"     , Color::Black      },
+            {"WHITE"     , Color::White      },
+            {"ORANGE"    , Color(255, 129,   0)},
+            {"YELLOW"    , Color::Yellow     },
+            {"GREEN"     , Color::Green      },
+            {"CYAN"      , Color::Cyan       },
+            {"GRAY"      , Color(128, 128, 128)},
+            {"DARK_GRAY" , Color(192, 192, 192)},
+            {"LIGHT_GRAY", Color( 64,  64,  64)},
+            {"MAGENTA"   , Color::Magenta    }
+        };
+        const char *s; size_t length;
+        if(!parseWord(p, end, s, length)) return false;
+        for(const auto &c: COLORS){
+            if(equalsIgnoreCase(s, length, c.first)){
+                color = c.second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Parse a word that is absent if it starts with a marker.
+     */
+    bool parseOptionalWord(const char *&p, const char *end, char marker, const char *&begin, size_t &length){
+        if(!parseWord(p, end, begin, length)) return false;
+        if(*begin == marker) length = 0;
+        return true;
+    }
+
+    /**
+     * @brief Parse node line (x, y, color , label , size, icon ).
+     */
+    bool parseNode(const char *p, const char *end, const GraphViewer::TextGraphOptions &options, GraphViewer::NodeDescriptor &d){
+        float x, y;
+        const char *label, *icon;
+        size_t labelLength, iconLength;
+        if(!(parseChar (p, end, '(') &&
+             parseFloat(p, end, x  ) && parseChar(p, end, ',') &&
+             parseFloat(p, end, y  ) && parseChar(p, end, ',') &&
+             parseColor(p, end, d.color) && parseChar(p, end, ',') &&
+             parseOptionalWord(p, end, '-', label, labelLength) && parseChar(p, end, ',') &&
+             parseFloat(p, end, d.size) && parseChar(p, end, ',') &&
+             parseOptionalWord(p, end, '-', icon, iconLength)))
+            return false;
+        d.position = Vector2f(x, y)*options.scale;
+        d.label.assign(label, labelLength);
+        if(iconLength > 0){
+            if(options.iconDirectory.empty()) d.icon.assign(icon, iconLength);
+            else d.icon = options.iconDirectory + "/" + string(icon, iconLength);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Parse edge line (u, v, type, color ,thickness, label , flow , weight ).
+     */
+    bool parseEdge(const char *p, const char *end, const GraphViewer::TextGraphOptions &options, GraphViewer::EdgeDescriptor &d){
+        uint64_t u, v, type;
+        const char *label, *flow, *weight;
+        size_t labelLength, flowLength, weightLength;
+        if(!(parseChar    (p, end, '(' ) &&
+             parseUnsigned(p, end, u   ) && parseChar(p, end, ',') &&
+             parseUnsigned(p, end, v   ) && parseChar(p, end, ',') &&
+             parseUnsigned(p, end, type) && parseChar(p, end, ',') &&
+             parseColor   (p, end, d.color) && parseChar(p, end, ',') &&
+             parseFloat   (p, end, d.thickness) && parseChar(p, end, ',') &&
+             parseOptionalWord(p, end, '-', label , labelLength ) && parseChar(p, end, ',') &&
+             parseOptionalWord(p, end, '%', flow  , flowLength  ) && parseChar(p, end, ',') &&
+             parseOptionalWord(p, end, '%', weight, weightLength)))
+            return false;
+        d.u = GraphViewer::id_t(u);
+        d.v = GraphViewer::id_t(v);
+        d.edge_type = (type ? GraphViewer::Edge::EdgeType::DIRECTED : GraphViewer::Edge::EdgeType::UNDIRECTED);
+        d.label.assign(label, labelLength);
+        d.dashed = options.dashed;
+        if(flowLength > 0){
+            d.hasFlow = true;
+            if(!parseFloat(flow, flow + flowLength, d.flow)) d.flow = 0.0;
+        }
+        if(weightLength > 0){
+            d.hasWeight = true;
+            if(!parseFloat(weight, weight + weightLength, d.weight)) d.weight = 0.0;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Result of parsing a chunk of a file.
+     */
+    template<class T>
+    struct Chunk {
+        const char *begin = nullptr;    ///< @brief Start of the chunk.
+        const char *end = nullptr;      ///< @brief End of the chunk.
+        vector<T> elements;             ///< @brief Parsed elements.
+        const char *error = nullptr;    ///< @brief Line that could not be parsed, or nullptr.
+        const char *errorEnd = nullptr; ///< @brief End of the line that could not be parsed.
+        exception_ptr exception;        ///< @brief Exception thrown while parsing.
+    };
+
+    /**
+     * @brief Parse the elements of a text graph file in parallel.
+     *
+     * The first line holds the number of elements; the following non-blank
+     * lines are split into chunks on line boundaries and parsed in parallel
+     * by the WorkerPool. Lines after the declared number of elements are ignored.
+     */
+    template<class T, class Parse>
+    vector<T> parseFile(const string &path, unsigned threads, Parse parse){
+        MappedFile file(path);
+        const char *p = file.getData(), *end = p + file.getSize();
+
+        uint64_t n;
+        if(!parseUnsigned(p, end, n))
+            throw runtime_error("Invalid number of elements in file " + path);
+        p = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+        p = (p == nullptr ? end : p+1);
+
+        if(threads == 0) threads = max(1u, thread::hardware_concurrency());
+        size_t numChunks = max(size_t(1), min(size_t(threads), size_t(end - p)/MIN_CHUNK_SIZE));
+        vector<Chunk<T>> chunks(numChunks);
+        const char *begin = p;
+        for(size_t i = 0; i < numChunks; ++i){
+            Chunk<T> &chunk = chunks[i];
+            chunk.begin = begin;
+            if(i+1 == numChunks){
+                chunk.end = end;
+            } else {
+                const char *q = p + size_t(end - p)*(i+1)/numChunks;
+                q = (q < begin ? begin : q);
+                q = static_cast<const char*>(memchr(q, '\n', size_t(end - q)));
+                chunk.end = (q == nullptr ? end : q+1);
+            }
+            begin = chunk.end;
+        }
+
+        auto work = [&parse, n](Chunk<T> *chunk){
+            try {
+                chunk->elements.reserve(min(uint64_t(chunk->end - chunk->begin)/16 + 1, n));
+                const char *line = chunk->begin;
+                while(line != chunk->end){
+                    const char *lineEnd = static_cast<const char*>(memchr(line, '\n', size_t(chunk->end - line)));
+                    if(lineEnd == nullptr) lineEnd = chunk->end;
+                    const char *q = line;
+                    skipSpaces(q, lineEnd);
+                    if(q != lineEnd){
+                        chunk->elements.emplace_back();
+                        if(!parse(line, lineEnd, chunk->elements.back())){
+                            chunk->elements.pop_back();
+                            chunk->error = line;
+                            chunk->errorEnd = lineEnd;
+                            return;
+                        }
+                    }
+                    line = (lineEnd == chunk->end ? lineEnd : lineEnd+1);
+                }
+            } catch(...){
+                chunk->exception = current_exception();
+            }
+        };
+        WorkerPool::getInstance().parallelFor(numChunks, [&chunks, &work](size_t first, size_t last){
+            for(size_t i = first; i < last; ++i)
+                work(&chunks[i]);
+        }, threads, 1);
+
+        // n comes from the file, so do not reserve more than was parsed
+        size_t parsed = 0;
+        for(const Chunk<T> &chunk: chunks)
+            parsed += chunk.elements.size();
+        vector<T> ret;
+        ret.reserve(size_t(min(n, uint64_t(parsed))));
+        for(Chunk<T> &chunk: chunks){
+            if(chunk.exception) rethrow_exception(chunk.exception);
+            for(T &element: chunk.elements){
+                if(ret.size() == n) return ret;
+                ret.push_back(move(element));
+            }
+            if(ret.size() < n && chunk.error != nullptr)
+                throw runtime_error("Invalid line in file " + path + ": " + string(chunk.error, chunk.errorEnd));
+        }
+        if(ret.size() < n)
+            throw runtime_error("File " + path + " has " + to_string(ret.size()) + " elements, expected " + to_string(n));
+        return ret;
+    }
+}
+
+void GraphViewer::loadText(const string &nodesPath, const string &edgesPath){
+    loadText(nodesPath, edgesPath, TextGraphOptions());
+}
+
+void GraphViewer::loadText(const string &nodesPath, const string &edgesPath, const TextGraphOptions &options){
+    vector<NodeDescriptor> nodeDescriptors = parseFile<NodeDescriptor>(nodesPath, options.threads,
+        [&options](const char *begin, const char *end, NodeDescriptor &d){ return parseNode(begin, end, options, d); }
+    );
+    vector<EdgeDescriptor> edgeDescriptors = parseFile<EdgeDescriptor>(edgesPath, options.threads,
+        [&options](const char *begin, const char *end, EdgeDescriptor &d){ return parseEdge(begin, end, options, d); }
+    );
+    for(size_t i = 0; i < nodeDescriptors.size(); ++i) nodeDescriptors[i].id = id_t(i);
+    for(size_t i = 0; i < edgeDescriptors.size(); ++i) edgeDescriptors[i].id = id_t(i);
+
+    addGraph(nodeDescriptors, edgeDescriptors);
+}
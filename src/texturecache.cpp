@@ -0,0 +1,98 @@
+#include "texturecache.h"
+
+#include <stdexcept>
+
+using namespace std;
+using namespace sf;
+
+const Texture& TextureCache::Entry::getTexture    () const { return *texture; }
+const IntRect& TextureCache::Entry::getTextureRect() const { return rect; }
+
+TextureCache& TextureCache::getInstance(){
+    static TextureCache instance;
+    return instance;
+}
+
+TextureCache::Handle TextureCache::get(const string &path){
+    lock_guard<std::mutex> lock(cacheMutex);
+    auto it = entries.find(path);
+    if(it != entries.end()){
+        Handle ret = it->second.lock();
+        if(ret != nullptr){
+            ++hits;
+            return ret;
+        }
+    }
+    ++misses;
+
+    Image image;
+    if(!image.loadFromFile(path))
+        throw runtime_error("Could not load texture from file " + path);
+
+    shared_ptr<Entry> entry = make_shared<Entry>();
+    Vector2u size = image.getSize();
+    if(atlas && size.x <= atlasMaxSize && size.y <= atlasMaxSize){
+        pack(image, *entry);
+    } else {
+        entry->texture = make_shared<Texture>();
+        if(!entry->texture->loadFromImage(image))
+            throw runtime_error("Could not create texture from file " + path);
+        entry->rect = IntRect(0, 0, int(size.x), int(size.y));
+    }
+
+    // Drop entries whose textures were released, so the map does not grow
+    // with every path ever loaded
+    if(entries.size() >= cleanupSize){
+        for(auto jt = entries.begin(); jt != entries.end(); ){
+            if(jt->second.expired()) jt = entries.erase(jt);
+            else ++jt;
+        }
+        cleanupSize = 2*entries.size() + 16;
+    }
+    entries[path] = entry;
+    return entry;
+}
+
+void TextureCache::pack(const Image &image, Entry &entry){
+    Vector2u size = image.getSize();
+    // Shelf packing: images are placed left to right in rows
+    if(atlasPage != nullptr && atlasX + size.x > ATLAS_SIZE){
+        atlasX = 0;
+        atlasY += atlasRowHeight + ATLAS_PADDING;
+        atlasRowHeight = 0;
+    }
+    if(atlasPage == nullptr || atlasY + size.y > ATLAS_SIZE){
+        atlasPage = make_shared<Texture>();
+        if(!atlasPage->create(ATLAS_SIZE, ATLAS_SIZE)){
+            atlasPage = nullptr;
+            throw runtime_error("Could not create atlas texture");
+        }
+        atlasX = atlasY = atlasRowHeight = 0;
+    }
+    atlasPage->update(image, atlasX, atlasY);
+    entry.texture = atlasPage;
+    entry.rect = IntRect(int(atlasX), int(atlasY), int(size.x), int(size.y));
+    atlasX += size.x + ATLAS_PADDING;
+    atlasRowHeight = max(atlasRowHeight, size.y);
+}
+
+void TextureCache::setAtlas(bool b, unsigned maxSize){
+    lock_guard<std::mutex> lock(cacheMutex);
+    atlas = b;
+    atlasMaxSize = (maxSize < ATLAS_SIZE ? maxSize : ATLAS_SIZE);
+    if(!atlas) atlasPage = nullptr;
+}
+
+size_t TextureCache::getSize() const {
+    lock_guard<std::mutex> lock(cacheMutex);
+    size_t ret = 0;
+    for(const auto &p: entries)
+        if(!p.second.expired()) ++ret;
+    return ret;
+}
+
+float TextureCache::getHitRate() const {
+    lock_guard<std::mutex> lock(cacheMutex);
+    if(hits + misses == 0) return 0.0f;
+    return float(hits)/float(hits + misses);
+}
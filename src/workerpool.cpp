@@ -0,0 +1,77 @@
+#include "workerpool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+WorkerPool& WorkerPool::getInstance(){
+    static WorkerPool instance;
+    return instance;
+}
+
+WorkerPool::~WorkerPool(){
+    {
+        lock_guard<mutex> lock(jobMutex);
+        stopping = true;
+        jobCV.notify_all();
+    }
+    for(thread &h: helpers) h.join();
+}
+
+void WorkerPool::parallelFor(size_t n, const Range &f, unsigned maxThreads, size_t minChunkSize){
+    size_t hardware = max(1u, thread::hardware_concurrency());
+    size_t threads = (maxThreads == 0 ? hardware : min(hardware, size_t(maxThreads)));
+    size_t chunks = max(size_t(1), min(threads, n/max(minChunkSize, size_t(1))));
+    if(chunks == 1){
+        f(0, n);
+        return;
+    }
+
+    lock_guard<mutex> runLock(runMutex);
+    unique_lock<mutex> lock(jobMutex);
+    while(helpers.size()+1 < hardware)
+        helpers.emplace_back(&WorkerPool::work, this);
+    job = &f;
+    jobSize = n;
+    numChunks = chunks;
+    nextChunk = 0;
+    pendingChunks = chunks;
+    jobCV.notify_all();
+    runChunks(lock);
+    doneCV.wait(lock, [this]{ return pendingChunks == 0; });
+    job = nullptr;
+    if(exception){
+        exception_ptr e = exception;
+        exception = nullptr;
+        rethrow_exception(e);
+    }
+}
+
+void WorkerPool::runChunks(unique_lock<mutex> &lock){
+    // Chunks are claimed under the lock, so a helper that wakes up late
+    // cannot claim a chunk of a loop that already finished
+    while(job != nullptr && nextChunk < numChunks){
+        const Range &f = *job;
+        size_t i = nextChunk++;
+        size_t begin = jobSize*i/numChunks, end = jobSize*(i+1)/numChunks;
+        lock.unlock();
+        exception_ptr e;
+        try {
+            f(begin, end);
+        } catch(...){
+            e = current_exception();
+        }
+        lock.lock();
+        if(e && !exception) exception = e;
+        if(--pendingChunks == 0) doneCV.notify_all();
+    }
+}
+
+void WorkerPool::work(){
+    unique_lock<mutex> lock(jobMutex);
+    while(true){
+        jobCV.wait(lock, [this]{ return stopping || (job != nullptr && nextChunk < numChunks); });
+        if(stopping) return;
+        runChunks(lock);
+    }
+}